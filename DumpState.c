@@ -20,12 +20,21 @@
 
 #include <limits.h>
 #include <inttypes.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
+#include "checkpoint.h"
+#include "checksum.h"
+#include "dictionary.h"
 #include "DumpState.h"
+#include "format.h"
+#include "index.h"
+#include "probe.h"
+#include "progress.h"
 #include "repository.h"
 #include "util.h"
 /* last */
@@ -35,31 +44,48 @@
 /*
  * in                current chunk of input bytes
  * old               previous chunk of input bytes
- * out               current line of output
+ * table             representation of every byte value, cf. format_table()
+ * ascii             ASCII column character of every byte value
+ * out               current line of output, a template of a complete line
+ *                     with every constant character (spaces, separators of
+ *                     the ASCII column, newline) in place, cf. _init()
  * out_after_offset  pointer to end of offset representation in current output
  *                     line
  * out_after_dump    pointer to end of dump (= start of ascii_col) in current
  *                     output line
+ * out_ascii         pointer to the characters of the ASCII column
  * out_eol           pointer to current end of output line (after the last
  *                     character)
- * out_len           length of one output line
+ * out_len           length of one (complete) output line
+ * counter           offset shown by the template, cf. _append_offset()
+ * position          number of characters written (cf. index.c)
  * offset            current offset in input stream
  * processed         number of already processed bytes of current file
  * read_count        number of bytes that has been read to "in"
+ * report            "processed" at which "progress_due" is tested next (once
+ *                     per "bufsize" bytes, cf. progress.c)
+ * written           whether a line has been written already
  * input             file handle for input
  * output            file handle for output
  */
 typedef struct {
 	unsigned char *in;
 	unsigned char *old;
+	char *table;
+	char ascii[UCHAR_MAX+1];
 	char *out;
 	char *out_after_offset;
 	char *out_after_dump;
+	char *out_ascii;
 	char *out_eol;
 	unsigned out_len;
+	uint_fast64_t counter;
+	uint_fast64_t position;
 	uint_fast64_t offset;
 	uint_fast64_t processed;
 	unsigned read_count;
+	uint_fast64_t report;
+	bool written;
 	FILE *input;
 	FILE *output;
 } Private;
@@ -68,10 +94,14 @@ typedef struct {
 static void _append_ascii_col(void);
 static void _append_newline(void);
 static void _append_offset(void);
+static void _checkpoint(DumpState *ds);
 static void _clean(void);
+static inline void _copy_values(char *out, unsigned char_width);
 static void _init(DumpState *ds, FILE *input, FILE *ouput);
 static void _print_last_offset(void);
 static void _read(DumpState *ds);
+static bool _reference(void);
+static void _restore(DumpState *ds);
 static void _translate_line(void);
 static void _write(void);
 
@@ -85,19 +115,33 @@ DumpState ds = {
 	.append_ascii_col = _append_ascii_col,
 	.append_newline = _append_newline,
 	.append_offset = _append_offset,
+	.checkpoint = _checkpoint,
 	.clean = _clean,
 	.init = _init,
 	.print_last_offset = _print_last_offset,
 	.read = _read,
+	.restore = _restore,
 	.translate_line = _translate_line,
 	.write = _write,
 };
 
 
 /* function definitions */
+/*
+ * Complete lines only need their characters in the template, the last
+ * (incomplete) line is padded and gets its own separators.
+ */
 void
 _append_ascii_col(void)
 {
+	unsigned i;
+
+	if (private.read_count == params.width) {
+		for (i = 0; i < params.width; i++)
+			private.out_ascii[i] = private.ascii[private.in[i]];
+		return;
+	}
+
 	while (private.out_eol < private.out_after_dump)
 		*(private.out_eol++) = ' ';
 
@@ -108,13 +152,41 @@ _append_ascii_col(void)
 void
 _append_newline(void)
 {
-	*private.out_eol++ = '\n';
+	/* the newline of complete lines is part of the template */
+	if (private.read_count < params.width)
+		*private.out_eol++ = '\n';
 }
 
+/*
+ * Count the offset in the template up to the current one, so that only the
+ * digits that change are written (usually one or two).
+ */
 void
 _append_offset(void)
 {
-	get_offset(private.out, private.offset);
+	count_offset(private.out, private.offset-private.counter);
+	private.counter = private.offset;
+}
+
+/*
+ * Only call between two lines, i.e. after write() or while masked, when the
+ * bytes read last have been dealt with completely.
+ */
+void
+_checkpoint(DumpState *ds)
+{
+	if (!checkpoint_due(private.offset+private.read_count))
+		return;
+
+	checkpoint.input = private.offset+private.read_count;
+	checkpoint.processed = private.processed+private.read_count;
+	checkpoint.offset = private.offset+private.read_count;
+	checkpoint.masked = ds->masked;
+	checkpoint.written = private.written;
+	/* while masked, "in" is the same as "old" */
+	memcpy(checkpoint.old, private.old, params.width);
+
+	checkpoint_save(private.output);
 }
 
 void
@@ -124,46 +196,108 @@ _clean(void)
 	memset(private.in, 0, params.width);
 	memset(private.old, 0, params.width);
 	memset(private.out, 0, private.out_len);
+	memset(private.ascii, 0, sizeof(private.ascii));
+	/* the blocks are kept for the next file, cf. arena.c */
 
-	free(private.in);
-	free(private.old);
-	free(private.out);
+	if (params.dictionary)
+		dictionary_clean();
+
+	progress_end(private.processed);
 }
 
+/*
+ * Copy the representation of every byte of a complete line to its place in
+ * the template; called with constant widths, so that the copies are inlined.
+ */
+void
+_copy_values(char *out, unsigned char_width)
+{
+	unsigned i, step = char_width+type.space;
+
+	for (i = 0; i < params.width; i++, out += step)
+		memcpy(out, private.table+private.in[i]*char_width, char_width);
+}
+
+/*
+ * Build the template of a complete line: offset, spaces between the values
+ * and the separators of the ASCII column or the newline, so that every line
+ * only has to write the values, the ASCII characters and the changed digits
+ * of the offset.
+ */
 void
 _init(DumpState *ds, FILE *input, FILE *output)
 {
+	char col[8];
+	unsigned char c;
+	unsigned v;
+
 	ds->finished = false;
 	ds->masked = false;
 
-	private.in = _malloc(params.width);
-	private.old = _malloc(params.width);
+	private.in = arena_block(ARENA_IN, params.width);
+	private.old = arena_block(ARENA_OLD, params.width);
+	private.table = format_table(arena_block(ARENA_TABLE,
+				format_table_size()));
+	/* like append_ascii_col() */
+	for (v = 0; v <= UCHAR_MAX; v++) {
+		c = v;
+		append_ascii_col(col, &c, 1);
+		private.ascii[v] = col[3];
+	}
 
-	private.out_len = OFFSET_CHAR_LEN+params.width*(type.char_width+type.space)
+	private.out_len = (params.offset ? offset_len : 0)
+		+ params.width*(type.char_width+type.space)
 		+ (params.ascii_col ? params.width+4+(!type.space) : !type.space);
 
-	private.out = _calloc(private.out_len, 1);
+	private.out = arena_block(ARENA_OUT, private.out_len);
+	memset(private.out, ' ', private.out_len);
 
 	private.out_after_offset = params.offset ?
-		private.out+OFFSET_CHAR_LEN : private.out;
+		private.out+offset_len : private.out;
 	private.out_after_dump = private.out_after_offset
 		+ params.width*(type.char_width+type.space)-(type.space ? 1 : 0);
+	if (params.ascii_col) {
+		private.out_after_dump[2] = '|';
+		private.out_ascii = private.out_after_dump+3;
+		private.out_ascii[params.width] = '|';
+		private.out_ascii[params.width+1] = '\n';
+	} else {
+		*private.out_after_dump = '\n';
+	}
 
 	private.out_eol = private.out;
 
-	private.offset = params.skip;
+	private.offset = params.base+params.skip;
+	private.counter = private.offset;
+	if (params.offset)
+		get_offset(private.out, private.counter);
+	private.position = 0;
 	private.processed = 0;
 	private.read_count = 0;
+	private.report = 0;
+	private.written = false;
 	private.input = input;
 	private.output = output;
+
+	if (params.dictionary)
+		dictionary_init();
 }
 
 void
 _print_last_offset(void)
 {
-	get_offset(private.out, private.offset+private.read_count);
-	private.out[OFFSET_CHAR_LEN] = '\n';
-	fwrite(private.out, 1, OFFSET_CHAR_LEN+1, private.output);
+	private.offset += private.read_count;
+	private.read_count = 0;
+	_append_offset();
+
+	/* checksums go next to the last offset (after the two spaces) */
+	if (params.checksum) {
+		fwrite(private.out, 1, offset_len, private.output);
+		checksum_print(private.output);
+		return;
+	}
+	private.out[offset_len] = '\n';
+	fwrite(private.out, 1, offset_len+1, private.output);
 }
 
 void
@@ -171,43 +305,130 @@ _read(DumpState *ds)
 {
 	unsigned read_len;
 
-	/* increment offset by number of previously read bytes */
-	private.offset += private.read_count;
-	private.processed += private.read_count;
-
-	read_len = (params.limited && private.processed+params.width > params.limit) ?
-		params.limit-private.processed : params.width;
-
-	private.read_count = fread(private.in, 1, read_len, private.input);
+	do {
+		/* increment offset by number of previously read bytes */
+		private.offset += private.read_count;
+		private.processed += private.read_count;
+		if (private.processed >= private.report) {
+			private.report = private.processed+bufsize;
+			if (progress_due)
+				progress_report(private.processed);
+		}
 
-	if (!private.read_count) {
-		ds->finished = true;
-		return;
-	} else if (private.read_count < read_len) {
-		ds->masked = false; /* output last line */
-		return;
-	}
+		read_len = (params.limited
+				&& private.processed+params.width > params.limit) ?
+			params.limit-private.processed : params.width;
+
+		private.read_count = fread(private.in, 1, read_len,
+				private.input);
+		PROBE2(read, private.offset, private.read_count);
+		if (params.checksum)
+			checksum_update(private.in, private.read_count);
+
+		if (!private.read_count) {
+			ds->finished = true;
+			ds->masked = false; /* do not wait for more lines */
+			return;
+		} else if (private.read_count < params.width) {
+			/* output last line (also the short one of "-l") */
+			ds->masked = false;
+			return;
+		}
 
-	/*
-	 * If it is not the first line (*out == 0) or the last line
-	 * (read < params.width), we check if we have to mask the output.
-	 */
-	if (!params.full && *private.out &&
-			!memcmp(private.in, private.old, private.read_count)) {
-		if (!ds->masked) {
-			fputs("*\n", private.output);
-			ds->masked = true;
+		/*
+		 * If it is not the first line (!written) or the last line
+		 * (read < params.width), we check if we have to mask the
+		 * output or to replace it by a back-reference.
+		 */
+		if (!params.full && private.written &&
+				!memcmp(private.in, private.old, private.read_count)) {
+			if (!ds->masked) {
+				PROBE2(mask, private.offset, private.read_count);
+				fputs("*\n", private.output);
+				private.position += 2;
+				ds->masked = true;
+			}
+			return;
 		}
-	} else {
 		ds->masked = false;
+	} while (params.dictionary && _reference());
+}
+
+/*
+ * Replace the current (complete) line by a back-reference if possible,
+ * cf. dictionary.c.
+ *
+ * return true if the line has been replaced.
+ */
+bool
+_reference(void)
+{
+	uint_fast64_t ref;
+	unsigned char *tmp;
+
+	if (!dictionary_lookup(private.in, private.processed, &ref))
+		return false;
+
+	if (params.offset) {
+		_append_offset();
+		fwrite(private.out, 1, offset_len, private.output);
 	}
+	fprintf(private.output, "@%"PRIXFAST64"+%X\n", ref, params.width);
+
+	/* the line counts as written */
+	private.written = true;
+	tmp = private.in;
+	private.in = private.old;
+	private.old = tmp;
+
+	return true;
+}
+
+/*
+ * Call after init() instead of reading the skipped bytes; the input must have
+ * been positioned at "checkpoint.input".
+ */
+void
+_restore(DumpState *ds)
+{
+	ds->masked = checkpoint.masked;
+
+	private.offset = checkpoint.offset;
+	private.processed = checkpoint.processed;
+	memcpy(private.old, checkpoint.old, params.width);
+	/* not the first line anymore, cf. _read() */
+	private.written = checkpoint.written;
 }
 
+/* the last (incomplete) line is converted as a whole */
 void
 _translate_line(void)
 {
-	private.out_eol = byte_to_numeric(private.out_after_offset, private.in,
-			private.read_count);
+	if (private.read_count < params.width) {
+		private.out_eol = byte_to_numeric(private.out_after_offset,
+				private.in, private.read_count);
+		PROBE2(translate, private.offset, private.read_count);
+		return;
+	}
+
+	switch (type.char_width) {
+	case 1:
+		_copy_values(private.out_after_offset, 1);
+		break;
+	case 2:
+		_copy_values(private.out_after_offset, 2);
+		break;
+	case 3:
+		_copy_values(private.out_after_offset, 3);
+		break;
+	case 8:
+		_copy_values(private.out_after_offset, 8);
+		break;
+	default:
+		_copy_values(private.out_after_offset, type.char_width);
+	}
+	private.out_eol = private.out+private.out_len;
+	PROBE2(translate, private.offset, private.read_count);
 }
 
 void
@@ -215,8 +436,14 @@ _write(void)
 {
 	unsigned char *tmp;
 
+	if (params.index)
+		index_add(private.processed, private.position);
+
 	fwrite(private.out, 1, private.out_eol-private.out, private.output);
-	
+	PROBE2(write, private.position, private.out_eol-private.out);
+	private.position += private.out_eol-private.out;
+	private.written = true;
+
 	/* swap in- and old-pointer */
 	tmp = private.in;
 	private.in = private.old;
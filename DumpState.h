@@ -27,9 +27,11 @@
  * append_ascii_col()  append ascii_col to output line
  * append_newline()    append newline to output line
  * append_offset()     append offste to output line
+ * checkpoint()        save the state if a checkpoint is due (cf. checkpoint.c)
  * init()              allocate and initialize the object structures
  * read()              read new bytes
  * print_last_offset() output last offset value (= file size) in own line
+ * restore()           continue from the state loaded by checkpoint_load()
  * translate_line()    translate bytes to numeric output string
  * write()             write output line
  * clean()             free all allocated space
@@ -41,10 +43,12 @@ struct DumpState {
 	void (*append_ascii_col)(void);
 	void (*append_newline)(void);
 	void (*append_offset)(void);
+	void (*checkpoint)(DumpState *ds);
 	void (*clean)(void);
 	void (*init)(DumpState *ds, FILE *input, FILE *output);
 	void (*print_last_offset)(void);
 	void (*read)(DumpState *ds);
+	void (*restore)(DumpState *ds);
 	void (*translate_line)(void);
 	void (*write)(void);
 };
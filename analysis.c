@@ -0,0 +1,219 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Analysis mode (option "-e BLOCK"): instead of dumping the bytes, report the
+ * byte histogram, the Shannon entropy and the ratio of zero and printable
+ * bytes of every block of BLOCK bytes, followed by a summary of the whole
+ * input. High entropy hints at compressed or encrypted data, many zeros at
+ * sparse regions and many printable bytes at text.
+ */
+
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "analysis.h"
+#include "arena.h"
+#include "checksum.h"
+#include "progress.h"
+#include "repository.h"
+#include "util.h"
+/* last */
+#include "ndc.h"
+
+
+#define VALUE_COUNT  (UCHAR_MAX+1)
+/* number of independent histograms, cf. count() */
+#define HIST_COUNT   4
+
+
+static void  count(const unsigned char *in, size_t n);
+static void  print_histogram(FILE *output, const uint_fast64_t *hist);
+static void  print_stats(FILE *output, uint_fast64_t offset,
+		const uint_fast64_t *hist, uint_fast64_t n);
+
+
+/*
+ * part    partial histograms of the current block, cf. count()
+ * block   histogram of the current block
+ * total   histogram of the whole input
+ */
+static uint_fast64_t  part[HIST_COUNT][VALUE_COUNT];
+static uint_fast64_t  block[VALUE_COUNT];
+static uint_fast64_t  total[VALUE_COUNT];
+
+
+/*
+ * Count the byte values of "in". Consecutive bytes go to different partial
+ * histograms, so that runs of equal bytes do not have to wait for the
+ * previous increment of the same counter.
+ */
+void
+count(const unsigned char *in, size_t n)
+{
+	for (; n >= HIST_COUNT; n -= HIST_COUNT, in += HIST_COUNT) {
+		part[0][in[0]]++;
+		part[1][in[1]]++;
+		part[2][in[2]]++;
+		part[3][in[3]]++;
+	}
+	while (n--)
+		part[0][*in++]++;
+}
+
+/*
+ * Analyze the input block by block.
+ * May be called multiple times if there are multiple files to process.
+ */
+bool
+dump_analysis(FILE *input, FILE *output)
+{
+	unsigned char *in;
+	uint_fast64_t fill = 0, offset = params.skip, processed = 0;
+	size_t i, len, n, run;
+	unsigned v;
+
+	if (skip_offset(input) == EOF) {
+		fprintf(output, "EOF reached after skipping %"SCNuFAST64" bytes.\n",
+				params.skip);
+		return true;
+	}
+
+	memset(part, 0, sizeof(part));
+	memset(total, 0, sizeof(total));
+
+	in = arena_block(ARENA_IN, bufsize);
+
+	fprintf(output, "%-*sentropy    zero   print  values\n",
+			params.offset ? (int)offset_len : 0,
+			params.offset ? "offset" : "");
+
+	for (;;) {
+		len = bufsize;
+		if (params.limited && params.limit-processed < len)
+			len = params.limit-processed;
+		n = len ? fread(in, 1, len, input) : 0;
+		processed += n;
+		if (params.checksum)
+			checksum_update(in, n);
+		if (progress_due)
+			progress_report(processed);
+
+		for (i = 0; i < n; i += run) {
+			run = params.analysis-fill < n-i ? params.analysis-fill : n-i;
+			count(in+i, run);
+			if ((fill += run) < params.analysis)
+				continue;
+			/* block complete */
+			for (v = 0; v < VALUE_COUNT; v++) {
+				block[v] = part[0][v]+part[1][v]+part[2][v]+part[3][v];
+				total[v] += block[v];
+			}
+			memset(part, 0, sizeof(part));
+			print_stats(output, offset, block, fill);
+			if (params.full)
+				print_histogram(output, block);
+			offset += fill;
+			fill = 0;
+		}
+		if (n < len || !len)
+			break;
+	}
+	/* incomplete last block */
+	if (fill) {
+		for (v = 0; v < VALUE_COUNT; v++) {
+			block[v] = part[0][v]+part[1][v]+part[2][v]+part[3][v];
+			total[v] += block[v];
+		}
+		print_stats(output, offset, block, fill);
+		if (params.full)
+			print_histogram(output, block);
+	}
+
+	progress_end(processed);
+
+	fputs("total:\n", output);
+	print_stats(output, params.skip+processed, total, processed);
+	print_histogram(output, total);
+	if (params.checksum)
+		checksum_print(output);
+
+	/* clear used memory */
+	memset(in, 0, bufsize);
+	/* the block is kept for the next file, cf. arena.c */
+
+	return ferror(input) ? false : true;
+}
+
+/* print the counts of all byte values, 16 per line */
+void
+print_histogram(FILE *output, const uint_fast64_t *hist)
+{
+	unsigned v;
+
+	for (v = 0; v < VALUE_COUNT; v++) {
+		if (!(v % 16))
+			fprintf(output, "  %02X:", v);
+		fprintf(output, " %"PRIuFAST64, hist[v]);
+		if (v % 16 == 15 || v == VALUE_COUNT-1)
+			fputc('\n', output);
+	}
+}
+
+/*
+ * Print offset (of the block or, for the summary, of the end of the input),
+ * entropy (bits per byte), percentage of zero and printable
+ * (including whitespace) bytes and number of distinct byte values for "n"
+ * bytes with histogram "hist".
+ */
+void
+print_stats(FILE *output, uint_fast64_t offset, const uint_fast64_t *hist,
+		uint_fast64_t n)
+{
+	char off[OFFSET_CHAR_LEN+1];
+	double entropy = 0, p;
+	uint_fast64_t print = 0;
+	unsigned v, values = 0;
+
+	for (v = 0; v < VALUE_COUNT; v++) {
+		if (!hist[v])
+			continue;
+		values++;
+		p = (double)hist[v]/n;
+		entropy -= p*log2(p);
+		if ((v >= 0x20 && v < 0x7f) || (v >= '\t' && v <= '\r'))
+			print += hist[v];
+	}
+
+	if (params.offset) {
+		get_offset(off, offset);
+		off[offset_len] = '\0';
+		fputs(off, output);
+	}
+	fprintf(output, "%7.4f %6.2f%% %6.2f%%  %6u\n", entropy,
+			n ? 100.0*hist[0]/n : 0.0, n ? 100.0*print/n : 0.0, values);
+}
@@ -0,0 +1,131 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Process-wide buffer arena: every buffer needed per file (stdio buffers of
+ * the files, lines of the dump, blocks of the other modes, lookup table,
+ * digits of the reverse mode, tables of "-m") is a block of its own, which is
+ * reused for the next file and only reallocated if it has to grow. So after
+ * the first file (with the same options), no file costs an allocation, which
+ * matters for runs over many small files and for the workers of the server
+ * (cf. server.c). The modes exclude each other, so they share the blocks
+ * "in" and "out".
+ *
+ * Not in the arena:
+ *   - the threads of "-j" and of the compression allocate their own buffers
+ *     once per file, as the arena is not shared between threads
+ *   - the ring of "-p" (cf. plain.c) is allocated once, as the pipe may
+ *     still refer to it
+ *   - getline() grows its own buffer (foreign dumps, "-P", "-M")
+ *   - "-M" dumps a single process once per run
+ *   - checkpoint_save() builds the name of its temporary file (cf.
+ *     checkpoint.c), which is rare
+ *
+ * Blocks are aligned to pages and their sizes are rounded up to powers of
+ * two, so that they grow rarely. Blocks of HUGE_SIZE bytes or more (e.g.
+ * "-b 2097152") are aligned to HUGE_SIZE and advised to be backed by
+ * transparent huge pages (Linux), which saves TLB misses.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "util.h"
+
+
+/* size and alignment of transparent huge pages */
+#define HUGE_SIZE  (2 << 20)
+
+
+static void  release(unsigned id);
+
+
+/*
+ * block   memory of every block
+ * size    size of every block
+ */
+static struct {
+	void *block[ARENA_COUNT];
+	size_t size[ARENA_COUNT];
+} arena;
+
+
+/*
+ * Block "id" of at least "size" bytes; its content is undefined (a block
+ * that has not to grow keeps the content of its last use).
+ */
+void *
+arena_block(unsigned id, size_t size)
+{
+	size_t align, n;
+	long page;
+
+	if (size <= arena.size[id])
+		return arena.block[id];
+
+	align = (page = sysconf(_SC_PAGESIZE)) > 0 ? page : 4096;
+	for (n = align; n < size; n *= 2)
+		;
+	if (n >= HUGE_SIZE)
+		align = HUGE_SIZE;
+
+	release(id);
+	if ((errno = posix_memalign(&arena.block[id], align, n)))
+		die("posix_memalign: %s", strerror(errno));
+	arena.size[id] = n;
+#if defined(MADV_HUGEPAGE)
+	if (n >= HUGE_SIZE)
+		madvise(arena.block[id], n, MADV_HUGEPAGE);
+#endif
+
+	return arena.block[id];
+}
+
+/* Free every block (e.g. before exit). */
+void
+arena_clean(void)
+{
+	unsigned id;
+
+	for (id = 0; id < ARENA_COUNT; id++)
+		release(id);
+}
+
+/* Free block "id" (if any), cleared like every other buffer. */
+void
+release(unsigned id)
+{
+	if (!arena.block[id])
+		return;
+
+	memset(arena.block[id], 0, arena.size[id]);
+	free(arena.block[id]);
+	arena.block[id] = NULL;
+	arena.size[id] = 0;
+}
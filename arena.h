@@ -0,0 +1,46 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+
+/* blocks of the arena, cf. arena.c */
+enum {
+	ARENA_INBUF,   /* stdio buffer of the input file */
+	ARENA_OUTBUF,  /* stdio buffer of the output file */
+	ARENA_IN,      /* current line of the dump, input block of other modes */
+	ARENA_OLD,     /* previous line of the dump */
+	ARENA_OUT,     /* output line of the dump, output block of other modes */
+	ARENA_TABLE,   /* representation of every byte value */
+	ARENA_DIGITS,  /* digits of the current number in reverse mode */
+	ARENA_LINES,   /* lines selected by "-S" */
+	ARENA_SLOTS,   /* lines of the hash table of "-m" */
+	ARENA_POS,     /* positions of the hash table of "-m" */
+	ARENA_HISTORY, /* last bytes reconstructed with "-m" in reverse mode */
+	ARENA_COUNT
+};
+
+
+void  *arena_block(unsigned id, size_t size);
+void   arena_clean(void);
+
+
+#endif /* ARENA_H */
@@ -0,0 +1,265 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Incremental re-dumps (option "-C DIR"): the input is dumped in blocks of
+ * CACHE_BLOCK bytes (rounded down to whole lines). The formatted lines of
+ * every block are stored in the directory DIR under the xxHash64 of
+ * everything they depend on:
+ *   - the settings affecting the layout (type, width, "-a", "-n", "-o",
+ *     "-f")
+ *   - the offset of the block (unless "-n" is given)
+ *   - the masking state at the beginning of the block and the previous line
+ *     (unless "-f" is given)
+ *   - the bytes of the block
+ * A later run over a mostly unchanged input only hashes the blocks and copies
+ * the lines of the unchanged ones from the cache; the other blocks are
+ * formatted (cf. format.c) and stored.
+ *
+ * An entry is the file DIR/HH/HHHHHHHHHHHHHH (the hash in hex): the masking
+ * state at the end of the block ('0' or '1'), followed by the lines. Entries
+ * are written atomically and never removed, so DIR may be shared by
+ * concurrent runs and emptied at any time (but not during a run).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "cache.h"
+#include "checksum.h"
+#include "format.h"
+#include "progress.h"
+#include "util.h"
+/* last */
+#include "ndc.h"
+
+
+/* size of the cached blocks */
+#define CACHE_BLOCK  (1 << 20)
+/* hashed first, so that a new format does not hit old entries */
+#define MAGIC        "ndc cache 1\n"
+
+
+static uint64_t  key(const Formatter *f, const unsigned char *in, size_t n,
+		uint_fast64_t offset);
+static bool      load(uint64_t k, char *out, size_t size, size_t *len,
+		bool *masked);
+static void      path(char *out, size_t size, uint64_t k, bool dir);
+static bool      store(uint64_t k, const char *out, size_t len, bool masked);
+
+
+bool
+dump_cache(FILE *input, FILE *output)
+{
+	Formatter f = { 0 };
+	unsigned char *in;
+	char *out;
+	uint_fast64_t offset = params.skip, processed = 0;
+	size_t block, size, n, len, last;
+	uint64_t k;
+	bool success = true, storing = true;
+
+	if (mkdir(params.cache, 0777) && errno != EEXIST)
+		die("Failed to create \"%s\": %s", params.cache, strerror(errno));
+
+	if (skip_offset(input) == EOF) {
+		fprintf(output, "EOF reached after skipping %"SCNuFAST64
+				" bytes.\n", params.skip);
+		return true;
+	}
+
+	block = CACHE_BLOCK/params.width ? CACHE_BLOCK/params.width*params.width
+		: params.width;
+	format_init(&f, arena_block(ARENA_TABLE, format_table_size()),
+			arena_block(ARENA_OLD, params.width));
+	size = format_size(&f, block);
+	in = arena_block(ARENA_IN, block);
+	/* one more character to detect oversized entries */
+	out = arena_block(ARENA_OUT, size+1);
+
+	for (;;) {
+		n = block;
+		if (params.limited && params.limit-processed < n)
+			n = params.limit-processed;
+		if (!n || !(n = fread(in, 1, n, input)))
+			break;
+		if (params.checksum)
+			checksum_update(in, n);
+		if (progress_due)
+			progress_report(processed+n);
+
+		k = key(&f, in, n, offset);
+		if (load(k, out, size, &len, &f.masked)) {
+			/* the state formatting the block would have left */
+			last = (n-1)/params.width*params.width;
+			memcpy(f.old, in+last, n-last);
+			f.written = true;
+		} else {
+			len = format_lines(&f, out, in, n, offset)-out;
+			if (storing && !store(k, out, len, f.masked)) {
+				err("Failed to write to the cache \"%s\": %s",
+						params.cache, strerror(errno));
+				storing = false;
+			}
+		}
+		fwrite(out, 1, len, output);
+
+		offset += n;
+		processed += n;
+	}
+	if (ferror(input))
+		success = false;
+
+	format_last_offset(output, offset, params.checksum);
+	progress_end(processed);
+
+	/* clear used memory */
+	memset(in, 0, block);
+	memset(out, 0, size+1);
+	memset(f.old, 0, params.width);
+	/* the blocks are kept for the next file, cf. arena.c */
+
+	return success;
+}
+
+/* hash of everything the lines of the "n" bytes of "in" depend on */
+uint64_t
+key(const Formatter *f, const unsigned char *in, size_t n,
+		uint_fast64_t offset)
+{
+	char settings[128];
+	Xxh64 x;
+	int len;
+
+	len = snprintf(settings, sizeof(settings), "%s %u %d %u %d %"PRIuFAST64
+			" %c\n", type.format, params.width, params.ascii_col,
+			params.offset ? offset_len : 0, params.full,
+			params.offset ? offset : 0,
+			params.full ? '-' : !f->written ? 'n' : f->masked ? 'm'
+			: 'w');
+
+	xxh64_init(&x);
+	xxh64_update(&x, (const unsigned char *)MAGIC, sizeof(MAGIC)-1);
+	xxh64_update(&x, (const unsigned char *)settings, len);
+	if (!params.full && f->written)
+		xxh64_update(&x, f->old, params.width);
+	xxh64_update(&x, in, n);
+
+	return xxh64_digest(&x);
+}
+
+/*
+ * Read the entry "k" into "out" (at most "size" characters).
+ *
+ * return false if there is no (valid) entry.
+ */
+bool
+load(uint64_t k, char *out, size_t size, size_t *len, bool *masked)
+{
+	char name[4096];
+	FILE *f;
+	int c;
+
+	path(name, sizeof(name), k, false);
+	if (!(f = fopen(name, "r")))
+		return false;
+
+	c = fgetc(f);
+	*len = fread(out, 1, size+1, f);
+	if (ferror(f) || (c != '0' && c != '1') || *len > size) {
+		fclose(f);
+		return false;
+	}
+	fclose(f);
+
+	*masked = c == '1';
+	return true;
+}
+
+/* write the name of the entry "k" (or of its directory if "dir") to "out" */
+void
+path(char *out, size_t size, uint64_t k, bool dir)
+{
+	int len;
+
+	if (dir) {
+		len = snprintf(out, size, "%s/%02x", params.cache,
+				(unsigned)(k >> 56));
+	} else {
+		len = snprintf(out, size, "%s/%02x/%014llx", params.cache,
+				(unsigned)(k >> 56),
+				(unsigned long long)(k & UINT64_C(0xffffffffffffff)));
+	}
+	if (len < 0 || (size_t)len >= size)
+		die("Name of the cache directory too long.");
+}
+
+/*
+ * Store the "len" characters of "out" as entry "k" (write to a temporary file
+ * first, so that there are no incomplete entries).
+ *
+ * return false on failure (errno is set).
+ */
+bool
+store(uint64_t k, const char *out, size_t len, bool masked)
+{
+	char name[4096], tmp[4096+32];
+	FILE *f;
+	int e;
+
+	path(name, sizeof(name), k, true);
+	if (mkdir(name, 0777) && errno != EEXIST)
+		return false;
+
+	path(name, sizeof(name), k, false);
+	snprintf(tmp, sizeof(tmp), "%s.%ld", name, (long)getpid());
+	if (!(f = fopen(tmp, "w")))
+		return false;
+	fputc(masked ? '1' : '0', f);
+	if (fwrite(out, 1, len, f) != len) {
+		e = errno;
+		fclose(f);
+		goto fail;
+	}
+	if (fclose(f) || rename(tmp, name)) {
+		e = errno;
+		goto fail;
+	}
+
+	return true;
+
+fail:
+	unlink(tmp);
+	errno = e;
+	return false;
+}
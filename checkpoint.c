@@ -0,0 +1,235 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checkpoints (options "-k FILE" and "-K"): every CHECKPOINT_INTERVAL bytes
+ * of input (or $NDC_CHECKPOINT_INTERVAL, e.g. for tests), the state of the
+ * dump (or of the reverse operation) is written to FILE, at a point where the
+ * output file is consistent with it. "-K" reads FILE, truncates the output
+ * file to the length saved and continues from the saved input position, so
+ * that the output is the same as the one of an uninterrupted run. FILE is
+ * removed after the last input file has been processed.
+ *
+ * FILE is written to a temporary file first and then renamed, so that it is
+ * never incomplete.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "checkpoint.h"
+#include "repository.h"
+#include "util.h"
+/* last */
+#include "ndc.h"
+
+
+/* bytes of input between two checkpoints */
+#define CHECKPOINT_INTERVAL  (64 << 20)
+#define MAGIC                "ndc checkpoint 1\n"
+
+
+static uint_fast64_t  interval(void);
+
+
+/* define "checkpoint", declared in "checkpoint.h" */
+Checkpoint checkpoint;
+
+
+/*
+ * Call before processing the file "name".
+ *
+ * return false if the file has been processed completely before the
+ * checkpoint we resume from.
+ */
+bool
+checkpoint_begin(const char *name)
+{
+	if (params.resume && checkpoint.current < checkpoint.file) {
+		checkpoint.current++;
+		return false;
+	} else if (params.resume && strcmp(name, checkpoint.name)) {
+		die("Checkpoint was made while processing \"%s\", not \"%s\".",
+				checkpoint.name, name);
+	}
+
+	snprintf(checkpoint.name, sizeof(checkpoint.name), "%s", name);
+	checkpoint.next = 0;
+	return true;
+}
+
+/*
+ * return true if the next checkpoint is due at input position "input", i.e.
+ * if the caller should fill "checkpoint" and call checkpoint_save().
+ */
+bool
+checkpoint_due(uint_fast64_t input)
+{
+	if (!checkpoint.next)
+		checkpoint.next = input+interval();
+
+	return input >= checkpoint.next;
+}
+
+/* call after processing a file: resuming happens only once */
+void
+checkpoint_end(void)
+{
+	checkpoint.current++;
+	params.resume = false;
+}
+
+/* all files have been processed, the checkpoint is not needed anymore */
+void
+checkpoint_finish(void)
+{
+	if (remove(params.checkpoint) && errno != ENOENT)
+		err("Failed to remove \"%s\": %s", params.checkpoint,
+				strerror(errno));
+}
+
+void
+checkpoint_load(void)
+{
+	char magic[sizeof(MAGIC)];
+	FILE *f;
+	unsigned i, masked, v, written;
+	size_t len;
+
+	if (!(f = fopen(params.checkpoint, "r")))
+		die("Failed to open \"%s\": %s", params.checkpoint, strerror(errno));
+
+	if (!fgets(magic, sizeof(magic), f) || strcmp(magic, MAGIC)
+			|| fscanf(f, "file %u ", &checkpoint.file) != 1
+			|| !fgets(checkpoint.name, sizeof(checkpoint.name), f))
+		die("\"%s\" is not a checkpoint.", params.checkpoint);
+	if ((len = strlen(checkpoint.name)) && checkpoint.name[len-1] == '\n')
+		checkpoint.name[len-1] = '\0';
+
+	if (fscanf(f, "input %"SCNuFAST64" output %"SCNuFAST64
+				" processed %"SCNuFAST64" offset %"SCNuFAST64
+				" masked %u written %u skip %"SCNuFAST64
+				" byte_count %"SCNuFAST64" old ",
+				&checkpoint.input, &checkpoint.output,
+				&checkpoint.processed, &checkpoint.offset, &masked,
+				&written, &checkpoint.skip, &checkpoint.byte_count) != 8)
+		die("\"%s\": invalid checkpoint.", params.checkpoint);
+	checkpoint.masked = masked;
+	checkpoint.written = written;
+
+	for (i = 0; i < params.width && !params.reverse; i++) {
+		if (fscanf(f, "%2x", &v) != 1)
+			die("\"%s\": invalid checkpoint.", params.checkpoint);
+		checkpoint.old[i] = v;
+	}
+
+	fclose(f);
+}
+
+/*
+ * Write "checkpoint" (filled by the caller). "output" is flushed first, so
+ * that its length matches the state.
+ */
+void
+checkpoint_save(FILE *output)
+{
+	char *tmp;
+	FILE *f;
+	off_t len;
+	unsigned i;
+
+	if (fflush(output))
+		die("Failed to write the output file: %s", strerror(errno));
+	if ((len = ftello(output)) < 0)
+		die("Failed to determine the length of the output file.");
+	checkpoint.output = len;
+	checkpoint.next = checkpoint.input+interval();
+
+	tmp = _malloc(strlen(params.checkpoint)+sizeof(".tmp"));
+	sprintf(tmp, "%s.tmp", params.checkpoint);
+	if (!(f = fopen(tmp, "w")))
+		die("Failed to create \"%s\": %s", tmp, strerror(errno));
+
+	fprintf(f, MAGIC "file %u %s\n", checkpoint.current, checkpoint.name);
+	fprintf(f, "input %"PRIuFAST64"\noutput %"PRIuFAST64"\n"
+			"processed %"PRIuFAST64"\noffset %"PRIuFAST64"\n"
+			"masked %u\nwritten %u\nskip %"PRIuFAST64"\n"
+			"byte_count %"PRIuFAST64"\nold ",
+			checkpoint.input, checkpoint.output, checkpoint.processed,
+			checkpoint.offset, checkpoint.masked, checkpoint.written,
+			checkpoint.skip, checkpoint.byte_count);
+	for (i = 0; i < params.width && !params.reverse; i++)
+		fprintf(f, "%02X", checkpoint.old[i]);
+	fputc('\n', f);
+
+	if (fflush(f) || fsync(fileno(f)) || fclose(f) || rename(tmp, params.checkpoint))
+		die("Failed to write \"%s\": %s", params.checkpoint, strerror(errno));
+
+	free(tmp);
+}
+
+/*
+ * Move to position "pos" of "input", by reading if it is not seekable.
+ *
+ * return false if EOF has been reached before.
+ */
+bool
+checkpoint_seek(FILE *input, uint_fast64_t pos)
+{
+	if (!fseeko(input, pos, SEEK_SET))
+		return true;
+
+	for (; pos; pos--) {
+		if (fgetc(input) == EOF)
+			return false;
+	}
+	return true;
+}
+
+/* cut off everything written after the checkpoint */
+void
+checkpoint_truncate(const char *outfile)
+{
+	if (truncate(outfile, checkpoint.output))
+		die("Failed to truncate \"%s\": %s", outfile, strerror(errno));
+}
+
+/* bytes of input between two checkpoints, cf. above */
+uint_fast64_t
+interval(void)
+{
+	static uint_fast64_t n;
+	const char *env;
+
+	if (!n && (!(env = getenv("NDC_CHECKPOINT_INTERVAL")) || strchr(env, '-')
+				|| sscanf(env, "%"SCNuFAST64, &n) != 1 || !n))
+		n = CHECKPOINT_INTERVAL;
+
+	return n;
+}
@@ -0,0 +1,71 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+
+/*
+ * State needed to continue an interrupted run (cf. checkpoint.c)
+ *
+ * file        index of the current input file
+ * name        name of the current input file
+ * input       position in the input file
+ * output      length of the output file
+ * processed   number of processed bytes of the current file
+ * offset      current offset (dump)
+ * masked      whether lines are currently masked with an asterisk (dump)
+ * written     whether a line has been written already (dump)
+ * old         the previous line (dump), cf. width limit in main()
+ * skip        number of bytes still to skip (reverse mode)
+ * byte_count  number of bytes written (reverse mode)
+ * next        input position of the next checkpoint (not saved)
+ * current     index of the file being processed (not saved)
+ */
+typedef struct {
+	unsigned file;
+	char name[4096];
+	uint_fast64_t input;
+	uint_fast64_t output;
+	uint_fast64_t processed;
+	uint_fast64_t offset;
+	bool masked;
+	bool written;
+	unsigned char old[256];
+	uint_fast64_t skip;
+	uint_fast64_t byte_count;
+	uint_fast64_t next;
+	unsigned current;
+} Checkpoint;
+
+
+bool  checkpoint_begin(const char *name);
+bool  checkpoint_due(uint_fast64_t input);
+void  checkpoint_end(void);
+void  checkpoint_finish(void);
+void  checkpoint_load(void);
+void  checkpoint_save(FILE *output);
+bool  checkpoint_seek(FILE *input, uint_fast64_t pos);
+void  checkpoint_truncate(const char *outfile);
+
+extern Checkpoint checkpoint;
+
+
+#endif /* CHECKPOINT_H */
@@ -0,0 +1,443 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checksums/digests of the bytes ndc processes (option "-c"), computed on the
+ * fly so that the input does not have to be read a second time.
+ * All of them are defined on octets, so only the lower eight bits of every
+ * byte are used if CHAR_BIT is greater than eight.
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <nmmintrin.h>
+#endif
+
+#include "checksum.h"
+#include "tune.h"
+
+
+#define CRC32C_POLY  0x82f63b78 /* Castagnoli, reflected */
+
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64-(r))))
+#define ROTR32(x, r) (((x) >> (r)) | ((x) << (32-(r))))
+
+#define XXH_PRIME1  UINT64_C(0x9e3779b185ebca87)
+#define XXH_PRIME2  UINT64_C(0xc2b2ae3d27d4eb4f)
+#define XXH_PRIME3  UINT64_C(0x165667b19e3779f9)
+#define XXH_PRIME4  UINT64_C(0x85ebca77c2b2ae63)
+#define XXH_PRIME5  UINT64_C(0x27d4eb2f165667c5)
+
+
+/*
+ * which       enabled checksums, cf. enum Checksum
+ * crc         current CRC32C value (not yet inverted)
+ * sha_h       SHA-256 hash value
+ * sha_buf     unprocessed rest of the input (< one SHA-256 block)
+ * sha_len     number of bytes in "sha_buf"
+ * sha_total   total number of bytes
+ * xxh         xxHash64 state
+ */
+typedef struct {
+	unsigned which;
+	uint32_t crc;
+	uint32_t sha_h[8];
+	unsigned char sha_buf[64];
+	unsigned sha_len;
+	uint64_t sha_total;
+	Xxh64 xxh;
+} Private;
+
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+		&& CHAR_BIT == 8
+static uint32_t  crc32c_sse42(uint32_t crc, const unsigned char *in, size_t n);
+#endif
+static uint32_t  crc32c_table(uint32_t crc, const unsigned char *in, size_t n);
+static uint32_t  load32(const unsigned char *p);
+static uint64_t  load64(const unsigned char *p);
+static void      sha256_block(const unsigned char *p);
+static void      sha256_print(FILE *f);
+static void      sha256_update(const unsigned char *in, size_t n);
+static uint64_t  xxh64_round(uint64_t acc, uint64_t input);
+
+
+/* private variables */
+static Private private;
+static uint32_t crc_table[256];
+/*
+ * CRC32C kernel: SSE4.2 if the CPU has it, unless the profile prefers the
+ * table (cf. tune.c)
+ */
+static uint32_t (*crc32c_update)(uint32_t crc, const unsigned char *in,
+		size_t n) = crc32c_table;
+
+static const uint32_t sha_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+	0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+	0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+	0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+	0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+	0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const uint32_t sha_init[8] = {
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+
+/* function definitions */
+void
+checksum_init(unsigned which)
+{
+	uint32_t c;
+	unsigned i, j;
+
+	memset(&private, 0, sizeof(private));
+	private.which = which;
+
+	private.crc = 0xffffffff;
+	if (!crc_table[1]) {
+		for (i = 0; i < 256; i++) {
+			for (c = i, j = 0; j < 8; j++)
+				c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+			crc_table[i] = c;
+		}
+	}
+	crc32c_update = crc32c_table;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+		&& CHAR_BIT == 8
+	if (which & CHECKSUM_CRC32C && tune_simd(KERNEL_CRC32C))
+		crc32c_update = crc32c_sse42;
+#endif
+
+	memcpy(private.sha_h, sha_init, sizeof(sha_init));
+
+	xxh64_init(&private.xxh);
+}
+
+/*
+ * Parse a comma-separated list of checksum names ("all" selects every one).
+ *
+ * return the combination of enum Checksum values or 0 on error.
+ */
+unsigned
+checksum_parse(const char *names)
+{
+	static const struct {
+		const char *name;
+		unsigned value;
+	} known[] = {
+		{ "all",    CHECKSUM_CRC32C | CHECKSUM_SHA256 | CHECKSUM_XXH64 },
+		{ "crc32c", CHECKSUM_CRC32C },
+		{ "sha256", CHECKSUM_SHA256 },
+		{ "xxh64",  CHECKSUM_XXH64 },
+	};
+	unsigned i, which = 0;
+	size_t len;
+
+	while (names && *names) {
+		len = strcspn(names, ",");
+		for (i = 0; i < sizeof(known)/sizeof(*known); i++) {
+			if (strlen(known[i].name) == len
+					&& !strncmp(names, known[i].name, len))
+				break;
+		}
+		if (i == sizeof(known)/sizeof(*known))
+			return 0;
+		which |= known[i].value;
+		names += len;
+		if (*names == ',')
+			names++;
+	}
+
+	return which;
+}
+
+/*
+ * Print all enabled checksums in one line, e.g.
+ *   "crc32c=e3069283 xxh64=44bc2cf5ad770999"
+ */
+void
+checksum_print(FILE *f)
+{
+	const char *sep = "";
+
+	if (private.which & CHECKSUM_CRC32C) {
+		fprintf(f, "crc32c=%08lx", (unsigned long)~private.crc);
+		sep = " ";
+	}
+	if (private.which & CHECKSUM_XXH64) {
+		fprintf(f, "%sxxh64=%016llx", sep,
+				(unsigned long long)xxh64_digest(&private.xxh));
+		sep = " ";
+	}
+	if (private.which & CHECKSUM_SHA256) {
+		fprintf(f, "%ssha256=", sep);
+		sha256_print(f);
+	}
+	fputc('\n', f);
+}
+
+void
+checksum_update(const unsigned char *in, size_t n)
+{
+	if (private.which & CHECKSUM_CRC32C)
+		private.crc = crc32c_update(private.crc, in, n);
+	if (private.which & CHECKSUM_SHA256)
+		sha256_update(in, n);
+	if (private.which & CHECKSUM_XXH64)
+		xxh64_update(&private.xxh, in, n);
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+		&& CHAR_BIT == 8
+/* Compiled for SSE4.2 whatever the target of the build, cf. checksum_init(). */
+__attribute__((target("sse4.2")))
+uint32_t
+crc32c_sse42(uint32_t crc, const unsigned char *in, size_t n)
+{
+#if defined(__x86_64__)
+	uint64_t c = crc;
+
+	for (; n >= 8; n -= 8, in += 8)
+		c = _mm_crc32_u64(c, load64(in));
+	crc = c;
+#endif
+	for (; n >= 4; n -= 4, in += 4)
+		crc = _mm_crc32_u32(crc, load32(in));
+	while (n--)
+		crc = _mm_crc32_u8(crc, *in++);
+
+	return crc;
+}
+#endif
+
+uint32_t
+crc32c_table(uint32_t crc, const unsigned char *in, size_t n)
+{
+	while (n--)
+		crc = crc_table[(crc ^ *in++) & 0xff] ^ (crc >> 8);
+
+	return crc;
+}
+
+/* little endian loads, independent of the byte order of the host */
+uint32_t
+load32(const unsigned char *p)
+{
+	return (uint32_t)(p[0] & 0xff) | (uint32_t)(p[1] & 0xff) << 8
+		| (uint32_t)(p[2] & 0xff) << 16 | (uint32_t)(p[3] & 0xff) << 24;
+}
+
+uint64_t
+load64(const unsigned char *p)
+{
+	return (uint64_t)load32(p) | (uint64_t)load32(p+4) << 32;
+}
+
+/* process one 64-byte block, cf. FIPS 180-4, section 6.2.2 */
+void
+sha256_block(const unsigned char *p)
+{
+	uint32_t a, b, c, d, e, f, g, h, s0, s1, t1, t2, w[64];
+	unsigned i;
+
+	for (i = 0; i < 16; i++, p += 4) {
+		w[i] = (uint32_t)(p[0] & 0xff) << 24 | (uint32_t)(p[1] & 0xff) << 16
+			| (uint32_t)(p[2] & 0xff) << 8 | (uint32_t)(p[3] & 0xff);
+	}
+	for (; i < 64; i++) {
+		s0 = ROTR32(w[i-15], 7) ^ ROTR32(w[i-15], 18) ^ (w[i-15] >> 3);
+		s1 = ROTR32(w[i-2], 17) ^ ROTR32(w[i-2], 19) ^ (w[i-2] >> 10);
+		w[i] = w[i-16] + s0 + w[i-7] + s1;
+	}
+
+	a = private.sha_h[0]; b = private.sha_h[1];
+	c = private.sha_h[2]; d = private.sha_h[3];
+	e = private.sha_h[4]; f = private.sha_h[5];
+	g = private.sha_h[6]; h = private.sha_h[7];
+
+	for (i = 0; i < 64; i++) {
+		s1 = ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25);
+		t1 = h + s1 + ((e & f) ^ (~e & g)) + sha_k[i] + w[i];
+		s0 = ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22);
+		t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+
+	private.sha_h[0] += a; private.sha_h[1] += b;
+	private.sha_h[2] += c; private.sha_h[3] += d;
+	private.sha_h[4] += e; private.sha_h[5] += f;
+	private.sha_h[6] += g; private.sha_h[7] += h;
+}
+
+/*
+ * Finish the digest (padding + length) and print it in hex.
+ * Leaves the state unusable for further updates.
+ */
+void
+sha256_print(FILE *f)
+{
+	unsigned char pad[72] = { 0x80 };
+	uint64_t bits = private.sha_total*8;
+	unsigned i, len;
+
+	len = (private.sha_len < 56 ? 56 : 120)-private.sha_len;
+	for (i = 0; i < 8; i++)
+		pad[len+i] = bits >> (56-8*i);
+	sha256_update(pad, len+8);
+
+	for (i = 0; i < 8; i++)
+		fprintf(f, "%08lx", (unsigned long)private.sha_h[i]);
+}
+
+void
+sha256_update(const unsigned char *in, size_t n)
+{
+	unsigned fill;
+
+	private.sha_total += n;
+
+	if (private.sha_len) {
+		fill = 64-private.sha_len < n ? 64-private.sha_len : n;
+		memcpy(private.sha_buf+private.sha_len, in, fill);
+		private.sha_len += fill;
+		in += fill;
+		n -= fill;
+		if (private.sha_len < 64)
+			return;
+		sha256_block(private.sha_buf);
+		private.sha_len = 0;
+	}
+	for (; n >= 64; n -= 64, in += 64)
+		sha256_block(in);
+
+	memcpy(private.sha_buf, in, n);
+	private.sha_len = n;
+}
+
+/* cf. https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md */
+uint64_t
+xxh64_digest(const Xxh64 *x)
+{
+	const unsigned char *p = x->buf;
+	unsigned n = x->len;
+	const uint64_t *v = x->v;
+	uint64_t h;
+	unsigned i;
+
+	if (x->total >= 32) {
+		h = ROTL64(v[0], 1) + ROTL64(v[1], 7) + ROTL64(v[2], 12)
+			+ ROTL64(v[3], 18);
+		for (i = 0; i < 4; i++) {
+			h ^= xxh64_round(0, v[i]);
+			h = h*XXH_PRIME1 + XXH_PRIME4;
+		}
+	} else {
+		h = XXH_PRIME5;
+	}
+	h += x->total;
+
+	for (; n >= 8; n -= 8, p += 8) {
+		h ^= xxh64_round(0, load64(p));
+		h = ROTL64(h, 27)*XXH_PRIME1 + XXH_PRIME4;
+	}
+	if (n >= 4) {
+		h ^= load32(p)*XXH_PRIME1;
+		h = ROTL64(h, 23)*XXH_PRIME2 + XXH_PRIME3;
+		n -= 4;
+		p += 4;
+	}
+	while (n--) {
+		h ^= (*p++ & 0xff)*XXH_PRIME5;
+		h = ROTL64(h, 11)*XXH_PRIME1;
+	}
+
+	h ^= h >> 33;
+	h *= XXH_PRIME2;
+	h ^= h >> 29;
+	h *= XXH_PRIME3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+void
+xxh64_init(Xxh64 *x)
+{
+	memset(x, 0, sizeof(*x));
+	x->v[0] = XXH_PRIME1 + XXH_PRIME2;
+	x->v[1] = XXH_PRIME2;
+	x->v[2] = 0;
+	x->v[3] = -XXH_PRIME1;
+}
+
+uint64_t
+xxh64_round(uint64_t acc, uint64_t input)
+{
+	acc += input*XXH_PRIME2;
+	acc = ROTL64(acc, 31);
+	return acc*XXH_PRIME1;
+}
+
+void
+xxh64_update(Xxh64 *x, const unsigned char *in, size_t n)
+{
+	uint64_t *v = x->v;
+	unsigned fill;
+
+	x->total += n;
+
+	if (x->len) {
+		fill = 32-x->len < n ? 32-x->len : n;
+		memcpy(x->buf+x->len, in, fill);
+		x->len += fill;
+		in += fill;
+		n -= fill;
+		if (x->len < 32)
+			return;
+		v[0] = xxh64_round(v[0], load64(x->buf));
+		v[1] = xxh64_round(v[1], load64(x->buf+8));
+		v[2] = xxh64_round(v[2], load64(x->buf+16));
+		v[3] = xxh64_round(v[3], load64(x->buf+24));
+		x->len = 0;
+	}
+	for (; n >= 32; n -= 32, in += 32) {
+		v[0] = xxh64_round(v[0], load64(in));
+		v[1] = xxh64_round(v[1], load64(in+8));
+		v[2] = xxh64_round(v[2], load64(in+16));
+		v[3] = xxh64_round(v[3], load64(in+24));
+	}
+
+	memcpy(x->buf, in, n);
+	x->len = n;
+}
@@ -0,0 +1,57 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+
+/* supported checksums/digests, may be combined */
+enum Checksum {
+	CHECKSUM_CRC32C = 1 << 0,
+	CHECKSUM_SHA256 = 1 << 1,
+	CHECKSUM_XXH64  = 1 << 2,
+};
+
+/*
+ * xxHash64 state, for hashes of their own (cf. cache.c)
+ *
+ * v      accumulators
+ * buf    unprocessed rest of the input (< one stripe)
+ * len    number of bytes in "buf"
+ * total  total number of bytes
+ */
+typedef struct {
+	uint64_t v[4];
+	unsigned char buf[32];
+	unsigned len;
+	uint64_t total;
+} Xxh64;
+
+
+void      checksum_init(unsigned which);
+unsigned  checksum_parse(const char *names);
+void      checksum_print(FILE *f);
+void      checksum_update(const unsigned char *in, size_t n);
+uint64_t  xxh64_digest(const Xxh64 *x);
+void      xxh64_init(Xxh64 *x);
+void      xxh64_update(Xxh64 *x, const unsigned char *in, size_t n);
+
+
+#endif /* CHECKSUM_H */
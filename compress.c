@@ -0,0 +1,522 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Transparent compression: gzip-compressed input files (and stdin) are
+ * recognised by their magic bytes and decompressed by a thread of their own
+ * while they are processed; with "-z LEVEL", the output ("-d" or stdout) is
+ * gzip-compressed by a thread, too. Both return stdio streams (cf.
+ * fopencookie()), so the rest of ndc does not need to know about it.
+ *
+ * The threads hand over buffers of "bufsize" uncompressed bytes through a
+ * queue of SLOTS slots, so that (de)compressing and formatting overlap and
+ * none of them gets more than SLOTS buffers ahead of the other.
+ *
+ * zstd-compressed input is recognised, too, but rejected: ndc is only built
+ * with zlib.
+ * This is only available on Linux; other systems read compressed input as it
+ * is and reject "-z".
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "compress.h"
+#include "repository.h"
+#include "util.h"
+/* last */
+#include "ndc.h"
+
+
+/* number of buffers between the thread and the stream */
+#define SLOTS  4
+
+
+/*
+ * raw          underlying (compressed) stream
+ * name         name of the input for error messages
+ * thread       (de)compressing thread
+ * lock         protects "head", "count", "end" and "stop"
+ * cond         signals changes of them
+ * buf, len     the slots and the number of bytes in each of them
+ * size         size of every slot and of "zbuf"
+ * head, count  first filled slot and number of filled slots; only the
+ *                consumer advances "head" and only the producer "count", so
+ *                the free slot returned by queue_wait() stays free until it
+ *                is put into the queue
+ * pos          read position in (input) or filling level of (output) the
+ *                slot used by the stream, which is buf[head] (input) or the
+ *                first free one (output)
+ * zbuf         compressed data
+ * end          whether no more slots will be filled
+ * stop         whether the stream has been closed (input)
+ * error        whether the data could not be (de)compressed
+ * magic, n     bytes read to recognise the input, handed out first by a
+ *                stream without thread
+ * z            zlib state
+ */
+typedef struct {
+	FILE *raw;
+	const char *name;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned char *buf[SLOTS];
+	size_t len[SLOTS];
+	size_t size;
+	unsigned head;
+	unsigned count;
+	size_t pos;
+	unsigned char *zbuf;
+	bool end;
+	bool stop;
+	bool error;
+	unsigned char magic[4];
+	unsigned n;
+	z_stream z;
+} Stream;
+
+
+#if defined(__linux__)
+static void     *deflate_work(void *arg);
+static void     *inflate_work(void *arg);
+static int       input_close(void *c);
+static ssize_t   input_read(void *c, char *out, size_t n);
+static int       output_close(void *c);
+static ssize_t   output_write(void *c, const char *in, size_t n);
+static int       passthrough_close(void *c);
+static ssize_t   passthrough_read(void *c, char *out, size_t n);
+static void      queue_put(Stream *s, unsigned slot, size_t len, bool end);
+static void      queue_release(Stream *s);
+static unsigned  queue_wait(Stream *s, bool free);
+static Stream   *stream_new(FILE *raw, const char *name, bool slots);
+static void      stream_free(Stream *s);
+#endif
+
+
+/*
+ * Whether the file "path" is compressed (or cannot be read), so that it
+ * cannot be accessed by position.
+ */
+bool
+compressed(const char *path)
+{
+	unsigned char magic[4] = { 0 };
+	FILE *f;
+
+	if (!(f = fopen(path, "rb")))
+		return true;
+	fread(magic, 1, sizeof(magic), f);
+	fclose(f);
+
+	return (magic[0] == 0x1f && magic[1] == 0x8b)
+		|| (magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f
+				&& magic[3] == 0xfd);
+}
+
+/*
+ * Recognise compressed data at the start of "raw" (named "name").
+ *
+ * return "raw" itself if it is not compressed, a stream of the decompressed
+ * data (to be closed before "raw") if it is or NULL if it cannot be
+ * decompressed.
+ */
+FILE *
+compress_input(FILE *raw, const char *name)
+{
+#if defined(__linux__)
+	static const unsigned char zstd[4] = { 0x28, 0xb5, 0x2f, 0xfd };
+	cookie_io_functions_t io = { 0 };
+	unsigned char magic[4];
+	unsigned n;
+	Stream *s;
+	FILE *f;
+	int c;
+
+	if ((c = getc(raw)) == EOF)
+		return raw;
+	if (c != 0x1f && c != zstd[0]) {
+		ungetc(c, raw);
+		return raw;
+	}
+
+	/* ungetc() only guarantees one byte, keep the others ourselves */
+	magic[0] = c;
+	for (n = 1; n < (magic[0] == zstd[0] ? 4 : 2)
+			&& (c = getc(raw)) != EOF; n++)
+		magic[n] = c;
+
+	if (n == 4 && !memcmp(magic, zstd, 4)) {
+		err("\"%s\" is zstd-compressed, which is not supported.", name);
+		return NULL;
+	}
+	if (n == 2 && magic[1] == 0x8b) {
+		s = stream_new(raw, name, true);
+		memcpy(s->zbuf, magic, n);
+		s->z.next_in = s->zbuf;
+		s->z.avail_in = n;
+		/* gzip only */
+		if (inflateInit2(&s->z, 16+MAX_WBITS) != Z_OK)
+			die("inflateInit2: %s", s->z.msg ? s->z.msg : "failed");
+		if (pthread_create(&s->thread, NULL, inflate_work, s))
+			die("pthread_create: failed to create a thread");
+		io.read = input_read;
+		io.close = input_close;
+	} else {
+		/* hand out the bytes we have read, then the rest of "raw" */
+		s = stream_new(raw, name, false);
+		memcpy(s->magic, magic, n);
+		s->n = n;
+		io.read = passthrough_read;
+		io.close = passthrough_close;
+	}
+
+	if (!(f = fopencookie(s, "rb", io)))
+		die("fopencookie: failed");
+	setvbuf(f, NULL, _IOFBF, bufsize);
+
+	return f;
+#else
+	(void)name;
+	return raw;
+#endif
+}
+
+/*
+ * Stream that compresses what is written to it with "params.compress" as
+ * level and writes it to "raw" (to be closed before "raw").
+ */
+FILE *
+compress_output(FILE *raw)
+{
+#if defined(__linux__)
+	cookie_io_functions_t io = { 0 };
+	Stream *s;
+	FILE *f;
+
+	s = stream_new(raw, NULL, true);
+	if (deflateInit2(&s->z, params.compress, Z_DEFLATED, 16+MAX_WBITS, 8,
+				Z_DEFAULT_STRATEGY) != Z_OK)
+		die("deflateInit2: %s", s->z.msg ? s->z.msg : "failed");
+	if (pthread_create(&s->thread, NULL, deflate_work, s))
+		die("pthread_create: failed to create a thread");
+
+	io.write = output_write;
+	io.close = output_close;
+	if (!(f = fopencookie(s, "wb", io)))
+		die("fopencookie: failed");
+	setvbuf(f, NULL, _IOFBF, bufsize);
+
+	return f;
+#else
+	(void)raw;
+	die("Compressed output is not supported on this system.");
+	return NULL;
+#endif
+}
+
+#if defined(__linux__)
+/* Compress the filled slots until the stream is closed. */
+void *
+deflate_work(void *arg)
+{
+	Stream *s = arg;
+	bool last = false;
+	size_t n;
+	int r;
+
+	while (!last) {
+		if (queue_wait(s, false)) {
+			s->z.next_in = s->buf[s->head];
+			s->z.avail_in = s->len[s->head];
+		} else {
+			last = true;
+		}
+		do {
+			s->z.next_out = s->zbuf;
+			s->z.avail_out = s->size;
+			r = deflate(&s->z, last ? Z_FINISH : Z_NO_FLUSH);
+			n = s->size - s->z.avail_out;
+			if (r == Z_STREAM_ERROR
+					|| fwrite(s->zbuf, 1, n, s->raw) != n)
+				s->error = true;
+		} while (!s->error && (s->z.avail_in || (last && r != Z_STREAM_END)));
+		if (!last)
+			queue_release(s);
+	}
+
+	return NULL;
+}
+
+/* Decompress "raw" into free slots until its end or until closed. */
+void *
+inflate_work(void *arg)
+{
+	Stream *s = arg;
+	unsigned slot;
+	int r = Z_OK;
+	bool last = false;
+	size_t n;
+
+	while (!last && (slot = queue_wait(s, true)) < SLOTS) {
+		s->z.next_out = s->buf[slot];
+		s->z.avail_out = s->size;
+		while (s->z.avail_out && !last) {
+			if (!s->z.avail_in) {
+				if (!(n = fread(s->zbuf, 1, s->size, s->raw))) {
+					/* the last member has to be complete */
+					if (r != Z_STREAM_END) {
+						err("\"%s\": unexpected end of compressed data.",
+								s->name);
+						s->error = true;
+					}
+					last = true;
+					break;
+				}
+				s->z.next_in = s->zbuf;
+				s->z.avail_in = n;
+			}
+			/* concatenated gzip files decompress to their concatenation */
+			if (r == Z_STREAM_END)
+				inflateReset(&s->z);
+			r = inflate(&s->z, Z_NO_FLUSH);
+			if (r != Z_OK && r != Z_STREAM_END && r != Z_BUF_ERROR) {
+				err("\"%s\": %s", s->name, s->z.msg
+						? s->z.msg : "invalid compressed data.");
+				s->error = last = true;
+			}
+		}
+		queue_put(s, slot, s->size - s->z.avail_out, last);
+	}
+
+	return NULL;
+}
+
+/* Stop and join the thread (the rest of the input is not read). */
+int
+input_close(void *c)
+{
+	Stream *s = c;
+
+	pthread_mutex_lock(&s->lock);
+	s->stop = true;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	pthread_join(s->thread, NULL);
+
+	inflateEnd(&s->z);
+	stream_free(s);
+
+	return 0;
+}
+
+ssize_t
+input_read(void *c, char *out, size_t n)
+{
+	Stream *s = c;
+	unsigned count;
+	size_t len;
+
+	/* only the last slot may be empty */
+	while ((count = queue_wait(s, false)) && !s->len[s->head])
+		queue_release(s);
+	if (!count)
+		return s->error ? -1 : 0;
+
+	len = s->len[s->head]-s->pos;
+	if (n > len)
+		n = len;
+	memcpy(out, s->buf[s->head]+s->pos, n);
+	if ((s->pos += n) == s->len[s->head]) {
+		s->pos = 0;
+		queue_release(s);
+	}
+
+	return n;
+}
+
+/* Hand over the last slot and wait for the thread to finish. */
+int
+output_close(void *c)
+{
+	Stream *s = c;
+	bool error;
+
+	/* the slot may be empty, it is needed to mark the end anyway */
+	queue_put(s, queue_wait(s, true), s->pos, true);
+	pthread_join(s->thread, NULL);
+
+	error = s->error || fflush(s->raw);
+	deflateEnd(&s->z);
+	stream_free(s);
+
+	return error ? EOF : 0;
+}
+
+ssize_t
+output_write(void *c, const char *in, size_t n)
+{
+	Stream *s = c;
+	unsigned slot;
+	size_t len, done = 0;
+
+	while (done < n) {
+		/* the slot is ours until it is put into the queue */
+		if (s->error || (slot = queue_wait(s, true)) >= SLOTS)
+			return -1;
+		len = s->size-s->pos < n-done ? s->size-s->pos : n-done;
+		memcpy(s->buf[slot]+s->pos, in+done, len);
+		done += len;
+		if ((s->pos += len) == s->size) {
+			queue_put(s, slot, s->size, false);
+			s->pos = 0;
+		}
+	}
+
+	return n;
+}
+
+int
+passthrough_close(void *c)
+{
+	stream_free(c);
+
+	return 0;
+}
+
+ssize_t
+passthrough_read(void *c, char *out, size_t n)
+{
+	Stream *s = c;
+	size_t r;
+
+	if (s->pos < s->n) {
+		if (n > s->n-s->pos)
+			n = s->n-s->pos;
+		memcpy(out, s->magic+s->pos, n);
+		s->pos += n;
+		return n;
+	}
+
+	r = fread(out, 1, n, s->raw);
+
+	return r || !ferror(s->raw) ? (ssize_t)r : -1;
+}
+
+/* Put the free slot "slot" (cf. queue_wait()) of "len" bytes into the queue. */
+void
+queue_put(Stream *s, unsigned slot, size_t len, bool end)
+{
+	pthread_mutex_lock(&s->lock);
+	s->len[slot] = len;
+	s->count++;
+	s->end = end;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+}
+
+/* Remove the first slot from the queue. */
+void
+queue_release(Stream *s)
+{
+	pthread_mutex_lock(&s->lock);
+	s->head = (s->head+1)%SLOTS;
+	s->count--;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+}
+
+/*
+ * Wait for a free slot ("free") or a filled one.
+ *
+ * return the index of the free slot (SLOTS if the stream has been stopped)
+ * or the number of filled slots (0 if no more slots will be filled).
+ */
+unsigned
+queue_wait(Stream *s, bool free)
+{
+	unsigned r;
+
+	pthread_mutex_lock(&s->lock);
+	if (free) {
+		while (s->count == SLOTS && !s->stop)
+			pthread_cond_wait(&s->cond, &s->lock);
+		r = s->stop ? SLOTS : (s->head+s->count)%SLOTS;
+	} else {
+		while (!s->count && !s->end)
+			pthread_cond_wait(&s->cond, &s->lock);
+		r = s->count;
+	}
+	pthread_mutex_unlock(&s->lock);
+
+	return r;
+}
+
+/* new Stream on "raw", with slots if it gets a thread */
+Stream *
+stream_new(FILE *raw, const char *name, bool slots)
+{
+	Stream *s = _malloc(sizeof(*s));
+	unsigned i;
+
+	memset(s, 0, sizeof(*s));
+	s->raw = raw;
+	s->name = name;
+	if (slots) {
+		s->size = bufsize;
+		for (i = 0; i < SLOTS; i++)
+			s->buf[i] = _malloc(s->size);
+		s->zbuf = _malloc(s->size);
+		pthread_mutex_init(&s->lock, NULL);
+		pthread_cond_init(&s->cond, NULL);
+	}
+
+	return s;
+}
+
+/* free "s" and clear the data that has passed through it */
+void
+stream_free(Stream *s)
+{
+	unsigned i;
+
+	if (s->zbuf) {
+		for (i = 0; i < SLOTS; i++) {
+			memset(s->buf[i], 0, s->size);
+			free(s->buf[i]);
+		}
+		memset(s->zbuf, 0, s->size);
+		free(s->zbuf);
+		pthread_mutex_destroy(&s->lock);
+		pthread_cond_destroy(&s->cond);
+	}
+	memset(s, 0, sizeof(*s));
+	free(s);
+}
+#endif
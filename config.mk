@@ -29,9 +29,12 @@ CFLAGS_PROFILING0 = -g -pg -std=c99 -pedantic -Wall -Wextra -O0 $(INCS) $(CPPFLA
 CFLAGS_PROFILING1 = -g -pg -std=c99 -pedantic -Wall -Wextra -O1 $(INCS) $(CPPFLAGS)
 CFLAGS_PROFILING2 = -g -pg -std=c99 -pedantic -Wall -Wextra -O2 $(INCS) $(CPPFLAGS)
 CFLAGS_PROFILING3 = -g -pg -std=c99 -pedantic -Wall -Wextra -O3 $(INCS) $(CPPFLAGS)
+CFLAGS_SANITIZE = -g -fsanitize=address,undefined -fno-omit-frame-pointer -std=c99 -pedantic -Wall -Wextra -O1 $(INCS) $(CPPFLAGS)
 CFLAGS = -std=c99 -pedantic -Wall -Wextra -O2 -march=native $(INCS) $(CPPFLAGS)
 
 LDFLAGS_PROFILING = -pg
+LDFLAGS_SANITIZE = -fsanitize=address,undefined
+LDLIBS = -lm -lpthread -lz
 
 CC = gcc
 
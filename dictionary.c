@@ -0,0 +1,157 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Back-references (option "-m SIZE"): a line of output that repeats a line of
+ * the last SIZE bytes is replaced by "@POS+LEN" - POS being the position of
+ * the earlier line (relative to "-s") and LEN its length, both in hex.
+ *
+ * The dump uses a hash table of complete lines (of about SIZE bytes), the
+ * reverse mode keeps the last SIZE bytes it has reconstructed in order to
+ * expand the references. So both need the same SIZE (or the reverse mode a
+ * bigger one).
+ */
+
+#include <inttypes.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "dictionary.h"
+#include "repository.h"
+#include "util.h"
+/* last */
+#include "ndc.h"
+
+
+/*
+ * lines      line of every slot of the hash table
+ * pos        position of every line plus 1 (0 = empty slot)
+ * slots      number of slots, power of two
+ * history    ring buffer of the last "params.dictionary" reconstructed bytes
+ * hist_len   number of bytes ever written to "history"
+ */
+typedef struct {
+	unsigned char *lines;
+	uint_fast64_t *pos;
+	size_t slots;
+	unsigned char *history;
+	uint_fast64_t hist_len;
+} Private;
+
+
+static uint_fast64_t  hash(const unsigned char *line);
+
+
+/* private variables */
+static Private private;
+
+
+/* function definitions */
+void
+dictionary_clean(void)
+{
+	if (private.lines)
+		memset(private.lines, 0, private.slots*params.width);
+	if (private.history)
+		memset(private.history, 0, params.dictionary);
+	/* the blocks are kept for the next file, cf. arena.c */
+	memset(&private, 0, sizeof(private));
+}
+
+void
+dictionary_init(void)
+{
+	if (params.reverse) {
+		private.history = arena_block(ARENA_HISTORY, params.dictionary);
+		private.hist_len = 0;
+		return;
+	}
+
+	for (private.slots = 1;
+			private.slots*2*params.width <= params.dictionary;
+			private.slots *= 2);
+	private.lines = arena_block(ARENA_SLOTS, private.slots*params.width);
+	private.pos = arena_block(ARENA_POS, private.slots*sizeof(*private.pos));
+	/* no slot is used yet */
+	memset(private.pos, 0, private.slots*sizeof(*private.pos));
+}
+
+/*
+ * Look up the complete line "line" at position "pos". If an identical line
+ * lies within the last "params.dictionary" bytes, store its position in
+ * "ref", move it to "pos" (keeping it in reach longer) and return true.
+ * Otherwise, remember "line" (replacing whatever was in its slot).
+ */
+bool
+dictionary_lookup(const unsigned char *line, uint_fast64_t pos,
+		uint_fast64_t *ref)
+{
+	size_t slot = hash(line) & (private.slots-1);
+	unsigned char *l = private.lines+slot*params.width;
+	bool found;
+
+	found = private.pos[slot] && pos-(private.pos[slot]-1) <= params.dictionary
+		&& !memcmp(l, line, params.width);
+	if (found)
+		*ref = private.pos[slot]-1;
+	else
+		memcpy(l, line, params.width);
+	private.pos[slot] = pos+1;
+
+	return found;
+}
+
+/* FNV-1a */
+uint_fast64_t
+hash(const unsigned char *line)
+{
+	uint_fast64_t h = UINT64_C(0xcbf29ce484222325);
+	unsigned i;
+
+	for (i = 0; i < params.width; i++)
+		h = (h ^ line[i]) * UINT64_C(0x100000001b3);
+
+	return h ^ (h >> 32);
+}
+
+/*
+ * return the reconstructed byte at position "pos", which has to be one of the
+ * last "params.dictionary" bytes (dies otherwise).
+ */
+unsigned char
+history_get(uint_fast64_t pos)
+{
+	if (pos >= private.hist_len || private.hist_len-pos > params.dictionary)
+		die("error: back-reference to %"PRIXFAST64" out of reach (-m).",
+				pos);
+
+	return private.history[pos % params.dictionary];
+}
+
+void
+history_put(unsigned char b)
+{
+	private.history[private.hist_len++ % params.dictionary] = b;
+}
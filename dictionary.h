@@ -0,0 +1,33 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+
+void           dictionary_clean(void);
+void           dictionary_init(void);
+bool           dictionary_lookup(const unsigned char *line, uint_fast64_t pos,
+		uint_fast64_t *ref);
+unsigned char  history_get(uint_fast64_t pos);
+void           history_put(unsigned char b);
+
+
+#endif /* DICTIONARY_H */
@@ -0,0 +1,390 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Reverse mode for the dumps of other tools: "xxd" (also with "-a", "-c",
+ * "-g" and "-u"), "hexdump -C" and "od -tx1" (also with "-An"). The layout
+ * is recognised from the first line of the input (cf. foreign_detect()) if
+ * the type is hexadecimal, so an archive of such dumps is restored without
+ * "xxd -r" or removing offsets and ASCII columns with sed first.
+ *
+ * Every character is looked up in a table giving the value of a digit or its
+ * class, the offset is parsed at the start of a line and the ASCII column is
+ * skipped. A line "*" stands for repetitions of the line before it up to the
+ * offset of the next line, which cannot be expanded without offsets
+ * ("od -An" without "-v").
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <limits.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "arena.h"
+#include "checksum.h"
+#include "foreign.h"
+#include "progress.h"
+#include "repository.h"
+#include "util.h"
+/* last */
+#include "ndc.h"
+
+
+/* longest prefix of the first line looked at to recognise the layout */
+#define HEAD_MAX  4096
+
+/* classes of characters besides the digit values 0-15, cf. Layout */
+#define BLANK     16
+#define COLON     17
+#define BAR       18
+#define OTHER     19
+
+
+/* recognised layouts, cf. layouts */
+enum Layout_id {
+	XXD,
+	HEXDUMP,
+	OD,
+	OD_AN
+};
+
+/*
+ * name          name of the tool (for error messages)
+ * offset_base   base of the offsets at the start of the lines, 0 = none
+ * offset_end    class of the character after an offset
+ * double_blank  whether two blanks end the values (the ASCII column follows)
+ *
+ * A BAR ends the values in every layout ("hexdump -C" puts the ASCII column
+ * between bars).
+ */
+typedef struct {
+	const char *name;
+	unsigned offset_base;
+	unsigned char offset_end;
+	bool double_blank;
+} Layout;
+
+
+static bool  byte_values(const char *p, bool whole);
+static bool  put(const unsigned char *in, size_t n);
+
+
+/* private variables */
+static const Layout layouts[] = {
+	[XXD] = { "xxd", 16, COLON, true },
+	[HEXDUMP] = { "hexdump -C", 16, BLANK, false },
+	[OD] = { "od", 8, BLANK, false },
+	[OD_AN] = { "od -An", 0, BLANK, false }
+};
+/*
+ * layout      layout of the current input, NULL = not recognised
+ * class       digit value or class of every character
+ * head        first line of the current input, cf. foreign_detect()
+ * head_len    length of "head"
+ * output      where put() writes to
+ * skip        bytes still to skip ("-s")
+ * count       bytes written ("-l")
+ */
+static struct {
+	const Layout *layout;
+	unsigned char class[UCHAR_MAX+1];
+	char head[HEAD_MAX];
+	size_t head_len;
+	FILE *output;
+	uint_fast64_t skip;
+	uint_fast64_t count;
+} foreign;
+
+
+/*
+ * Whether "p" starts with two hexadecimal digits and a blank or the end of
+ * the line - or, if "whole", consists of such values, each preceded by a
+ * blank.
+ */
+bool
+byte_values(const char *p, bool whole)
+{
+	do {
+		if (whole && *p++ != ' ')
+			return false;
+		if (foreign.class[(unsigned char)p[0]] >= 16
+				|| foreign.class[(unsigned char)p[1]] >= 16
+				|| (p[2] != ' ' && p[2] != '\n' && p[2]))
+			return false;
+		p += 2;
+	} while (whole && *p && *p != '\n');
+
+	return true;
+}
+
+/*
+ * Reverse the input recognised by foreign_detect(), starting with its first
+ * line.
+ *
+ * return false on errors.
+ */
+bool
+dump_reverse_foreign(FILE *input, FILE *output)
+{
+	const Layout *l = foreign.layout;
+	const unsigned char *class = foreign.class;
+	unsigned char *bytes = NULL, *tmp;
+	char *line = NULL, *first;
+	const char *p, *end;
+	size_t cap = 0, size = 0, n = 0, prev = 0;
+	uint_fast64_t offset = 0, position = 0, processed = 0;
+	unsigned long number;
+	unsigned c, v = 0, digits;
+	ssize_t len, rest;
+	bool more = true, repeat = false, blank;
+
+	foreign.output = output;
+	foreign.skip = params.skip;
+	foreign.count = 0;
+
+	for (number = 1; more; number++) {
+		if (number == 1) {
+			p = foreign.head;
+			len = foreign.head_len;
+			/* the rest of a first line longer than HEAD_MAX-1 */
+			if (foreign.head[len-1] != '\n'
+					&& (rest = getline(&line, &cap, input)) > 0) {
+				first = _malloc(len+rest+1);
+				memcpy(first, foreign.head, len);
+				memcpy(first+len, line, rest+1);
+				memset(line, 0, cap);
+				free(line);
+				line = first;
+				cap = len+rest+1;
+				p = line;
+				len += rest;
+			}
+		} else if ((len = getline(&line, &cap, input)) > 0) {
+			p = line;
+		} else {
+			break;
+		}
+		end = p+len;
+		if (end > p && end[-1] == '\n')
+			end--;
+		processed += len;
+		if (progress_due)
+			progress_report(processed);
+
+		if (end-p == 1 && *p == '*') {
+			if (!l->offset_base)
+				die("line %lu: \"*\" cannot be expanded without "
+						"offsets (use \"od -v\").", number);
+			repeat = true;
+			continue;
+		}
+
+		/*
+		 * a line cannot have more values than characters; the values
+		 * of the line before are kept for "*"
+		 */
+		if ((size_t)(end-p) > size) {
+			if (prev) {
+				tmp = arena_block(ARENA_OLD, prev);
+				memcpy(tmp, bytes, prev);
+			}
+			bytes = arena_block(ARENA_OUT, end-p);
+			if (prev)
+				memcpy(bytes, tmp, prev);
+			size = end-p;
+		}
+
+		if (l->offset_base) {
+			for (offset = 0, digits = 0; p < end
+					&& (c = class[(unsigned char)*p]) < l->offset_base;
+					p++, digits++)
+				offset = offset*l->offset_base+c;
+			if (!digits || (p < end && class[(unsigned char)*p++]
+						!= l->offset_end))
+				die("line %lu: invalid offset (%s).", number,
+						l->name);
+
+			/* the lines left out repeat the line before */
+			if (repeat) {
+				if (!prev || offset < position
+						|| (offset-position) % prev)
+					die("line %lu: \"*\" does not fit the "
+							"offsets.", number);
+				for (; more && position < offset; position += prev)
+					more = put(bytes, prev);
+				repeat = false;
+			}
+			position = offset;
+		}
+
+		for (n = 0, digits = 0, blank = false; p < end; p++) {
+			if ((c = class[(unsigned char)*p]) < 16) {
+				v = v << 4 | c;
+				if (++digits == 2) {
+					bytes[n++] = v;
+					digits = 0;
+				}
+				blank = false;
+				continue;
+			} else if (digits) {
+				die("line %lu: incomplete value.", number);
+			} else if (c == BAR || (c == BLANK && blank
+						&& l->double_blank)) {
+				break;
+			} else if (c != BLANK) {
+				die("line %lu: invalid character -- \"%c\" (%s).",
+						number, *p, l->name);
+			}
+			blank = true;
+		}
+		if (digits)
+			die("line %lu: incomplete value.", number);
+
+		/* the last line of "hexdump -C" and "od" is only an offset */
+		if (n) {
+			more = put(bytes, n);
+			prev = n;
+			position += n;
+		}
+	}
+	if (more && repeat)
+		die("unexpected end of input after \"*\".");
+	progress_end(processed);
+
+	/* clear used memory */
+	if (bytes)
+		memset(bytes, 0, size);
+	/* the block is kept for the next file, cf. arena.c */
+	if (line)
+		memset(line, 0, cap);
+	free(line);
+	memset(foreign.head, 0, sizeof(foreign.head));
+
+	return ferror(input) ? false : true;
+}
+
+/*
+ * Read the first line of "input" (in reverse mode with a hexadecimal type,
+ * not with "-I", "-k", "-m" and "-p") and recognise the layout of another
+ * tool's dump.
+ *
+ * return true if it is one (for dump_reverse_foreign()). Otherwise "input"
+ * has been set back to where it was or, if it cannot seek, the line read is
+ * left in "*head" ("*n" bytes) for dump_reverse().
+ */
+bool
+foreign_detect(FILE *input, const char **head, size_t *n)
+{
+	char *cut = NULL;
+	const char *p;
+	unsigned i, digits;
+	off_t start;
+
+	*n = 0;
+	foreign.layout = NULL;
+	if (params.index || params.checkpoint || params.dictionary
+			|| params.plain || (type.type != HEX_LC
+				&& type.type != HEX_UC))
+		return false;
+
+	for (i = 0; i <= UCHAR_MAX; i++)
+		foreign.class[i] = OTHER;
+	for (i = 0; i < 16; i++) {
+		foreign.class[(unsigned char)"0123456789abcdef"[i]] = i;
+		foreign.class[(unsigned char)"0123456789ABCDEF"[i]] = i;
+	}
+	foreign.class[' '] = foreign.class['\t'] = foreign.class['\r'] = BLANK;
+	foreign.class[':'] = COLON;
+	foreign.class['|'] = BAR;
+
+	start = ftello(input);
+	if (!fgets(foreign.head, sizeof(foreign.head), input))
+		return false;
+	foreign.head_len = strlen(foreign.head);
+
+	/*
+	 * A longer first line is recognised by its prefix, up to its last
+	 * blank (complete values only).
+	 */
+	p = foreign.head;
+	if (foreign.head[foreign.head_len-1] != '\n'
+			&& (cut = strrchr(foreign.head, ' ')))
+		*cut = '\0';
+
+	for (digits = 0; foreign.class[(unsigned char)p[digits]] < 16;
+			digits++);
+	if (digits >= 8 && p[digits] == ':' && p[digits+1] == ' ')
+		foreign.layout = &layouts[XXD];
+	else if (digits >= 8 && !strncmp(p+digits, "  ", 2)
+			&& byte_values(p+digits+2, false))
+		foreign.layout = &layouts[HEXDUMP];
+	else if (digits >= 7 && strspn(p, "01234567") == digits
+			&& byte_values(p+digits, true))
+		foreign.layout = &layouts[OD];
+	else if (!digits && *p == ' ' && byte_values(p, true))
+		foreign.layout = &layouts[OD_AN];
+	if (cut)
+		*cut = ' ';
+
+	if (foreign.layout)
+		return true;
+	if (start < 0 || fseeko(input, start, SEEK_SET)) {
+		*head = foreign.head;
+		*n = foreign.head_len;
+	}
+
+	return false;
+}
+
+/*
+ * Write the "n" bytes of "in", respecting "-s" and "-l".
+ *
+ * return false if the limit has been reached.
+ */
+bool
+put(const unsigned char *in, size_t n)
+{
+	uint_fast64_t k;
+	bool more = true;
+
+	if (foreign.skip) {
+		k = foreign.skip < n ? foreign.skip : n;
+		foreign.skip -= k;
+		in += k;
+		n -= k;
+	}
+	if (params.limited && n >= params.limit-foreign.count) {
+		n = params.limit-foreign.count;
+		more = false;
+	}
+	foreign.count += n;
+
+	if (params.checksum)
+		checksum_update(in, n);
+	fwrite(in, 1, n, foreign.output);
+
+	return more;
+}
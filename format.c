@@ -0,0 +1,191 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Formatting of dump lines with a lookup table per byte value, for the modes
+ * that format whole chunks of the input at once (cf. cache.c and multi.c).
+ * The state (previous line, masking) is kept in a Formatter, so that chunks
+ * may be formatted one after another (and several representations at once).
+ *
+ * The output is the same as the one of dump().
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "checksum.h"
+#include "format.h"
+#include "repository.h"
+#include "util.h"
+/* last */
+#include "ndc.h"
+
+
+#define VALUE_COUNT  (UCHAR_MAX+1)
+
+
+/* free the buffers allocated by format_init() */
+void
+format_clean(Formatter *f)
+{
+	free(f->old);
+	free(f->table);
+	f->old = NULL;
+	f->table = NULL;
+}
+
+/*
+ * Formatter of the current type, with the lookup table "table" (cf.
+ * format_table()) and the previous line "old" (of params.width bytes) or, if
+ * NULL, new ones to be freed by format_clean().
+ */
+void
+format_init(Formatter *f, char *table, unsigned char *old)
+{
+	f->type = type;
+	f->table = format_table(table);
+	f->old = old ? old : _malloc(params.width);
+	f->masked = false;
+	f->written = false;
+}
+
+/* like the last offset of dump(), followed by the checksums if "checksum" */
+void
+format_last_offset(FILE *output, uint_fast64_t offset, bool checksum)
+{
+	char out[OFFSET_CHAR_LEN];
+
+	if (!params.offset) {
+		if (checksum)
+			checksum_print(output);
+		return;
+	}
+
+	get_offset(out, offset);
+	fwrite(out, 1, offset_len, output);
+	if (checksum)
+		checksum_print(output);
+	else
+		fputc('\n', output);
+}
+
+/*
+ * Format the "n" bytes of "in" (whole lines but the last one of the input)
+ * like dump() to "out", which has to hold format_size() characters.
+ *
+ * return pointer to index after last character written.
+ */
+char *
+format_lines(Formatter *f, char *out, const unsigned char *in, size_t n,
+		uint_fast64_t offset)
+{
+	unsigned len, i;
+
+	for (; n; in += len, n -= len, offset += len) {
+		len = n < params.width ? n : params.width;
+
+		/* mask repeated lines, but never the last (incomplete) one */
+		if (!params.full && f->written && len == params.width
+				&& !memcmp(in, f->old, len)) {
+			if (!f->masked) {
+				*out++ = '*';
+				*out++ = '\n';
+				f->masked = true;
+			}
+			continue;
+		}
+		f->masked = false;
+
+		if (params.offset) {
+			get_offset(out, offset);
+			out += offset_len;
+		}
+		for (i = 0; i < len; i++) {
+			memcpy(out, f->table+in[i]*f->type.char_width,
+					f->type.char_width);
+			out += f->type.char_width;
+			if (f->type.space && i < len-1)
+				*out++ = ' ';
+		}
+		if (params.ascii_col) {
+			/* pad incomplete lines */
+			for (i = len; i < params.width; i++) {
+				memset(out, ' ', f->type.char_width+f->type.space);
+				out += f->type.char_width+f->type.space;
+			}
+			out = append_ascii_col(out, in, len);
+		} else {
+			*out++ = '\n';
+		}
+
+		memcpy(f->old, in, len);
+		f->written = true;
+	}
+
+	return out;
+}
+
+/* maximum number of characters format_lines() writes for "n" bytes */
+size_t
+format_size(const Formatter *f, size_t n)
+{
+	size_t line_len = OFFSET_CHAR_LEN
+		+ params.width*(f->type.char_width+f->type.space)
+		+ params.width+4+1;
+
+	return (n+params.width-1)/params.width*line_len;
+}
+
+/*
+ * Build the lookup table of the current type: the representation of every
+ * byte value (type.char_width characters each) into "table" (of
+ * format_table_size() bytes) or, if NULL, a new one. The table is built by
+ * byte_to_numeric() itself, so it is the same conversion as dump().
+ */
+char *
+format_table(char *table)
+{
+	unsigned char c;
+	unsigned v;
+
+	if (!table)
+		table = _malloc(format_table_size());
+
+	for (v = 0; v < VALUE_COUNT; v++) {
+		c = v;
+		byte_to_numeric(table+v*type.char_width, &c, 1);
+	}
+
+	return table;
+}
+
+/*
+ * Size of the lookup table of the current type: byte_to_numeric() appends the
+ * space after the last value, too.
+ */
+size_t
+format_table_size(void)
+{
+	return VALUE_COUNT*type.char_width+1;
+}
@@ -0,0 +1,55 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include "repository.h"
+
+
+/*
+ * Table-driven formatter of dump lines (cf. format.c)
+ *
+ * type     numeric system
+ * table    representation of every byte value (type.char_width characters)
+ * old      previous line
+ * masked   whether lines are currently masked with an asterisk
+ * written  whether a line has been written already
+ */
+typedef struct {
+	Repository type;
+	char *table;
+	unsigned char *old;
+	bool masked;
+	bool written;
+} Formatter;
+
+
+void    format_clean(Formatter *f);
+void    format_init(Formatter *f, char *table, unsigned char *old);
+void    format_last_offset(FILE *output, uint_fast64_t offset, bool checksum);
+char   *format_lines(Formatter *f, char *out, const unsigned char *in,
+		size_t n, uint_fast64_t offset);
+size_t  format_size(const Formatter *f, size_t n);
+char   *format_table(char *table);
+size_t  format_table_size(void);
+
+
+#endif /* FORMAT_H */
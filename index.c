@@ -0,0 +1,149 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Index of a dump (option "-I FILE"): while dumping, the position of the
+ * first line of every STRIDE ("-i") input bytes in the output is written to
+ * FILE. The reverse mode with the same "-I FILE" seeks straight to the last
+ * line at or before "-s" instead of decoding everything before it.
+ *
+ * FILE is text:
+ *   ndc index 1
+ *   stride STRIDE
+ *   header LENGTH      (of the line "Processing ...")
+ *   OFFSET POSITION    (hex, for every STRIDE bytes)
+ *   ...
+ * OFFSET counts the bytes dumped (i.e. after "-s"), POSITION the characters
+ * written after the line "Processing ...", which may have been removed
+ * before reversing (cf. index_seek()). Positions of lines within masked runs
+ * ("*") are not indexed, the next line written is.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "index.h"
+#include "repository.h"
+#include "util.h"
+/* last */
+#include "ndc.h"
+
+
+#define MAGIC           "ndc index 1\n"
+#define HEADER          "Processing "
+/* default of "-i" */
+#define STRIDE_DEFAULT  (1 << 20)
+
+
+/*
+ * file    index being written
+ * stride  number of input bytes between two entries
+ * next    offset of the next entry
+ */
+typedef struct {
+	FILE *file;
+	uint_fast64_t stride;
+	uint_fast64_t next;
+} Private;
+
+
+/* private variables */
+static Private private;
+
+
+/*
+ * Add the line starting at "offset" (bytes dumped so far), "position"
+ * characters after the header, if it is the first one of a stride.
+ */
+void
+index_add(uint_fast64_t offset, uint_fast64_t position)
+{
+	if (offset < private.next)
+		return;
+
+	fprintf(private.file, "%"PRIXFAST64" %"PRIXFAST64"\n", offset,
+			position);
+	private.next = (offset/private.stride+1)*private.stride;
+}
+
+/* start the index of a dump whose header line has "header" characters */
+void
+index_begin(unsigned header)
+{
+	if (!(private.file = fopen(params.index, "w")))
+		die("Failed to create \"%s\": %s", params.index, strerror(errno));
+
+	private.stride = params.index_stride ? params.index_stride
+		: STRIDE_DEFAULT;
+	private.next = 0;
+	fprintf(private.file, MAGIC "stride %"PRIuFAST64"\nheader %u\n",
+			private.stride, header);
+}
+
+void
+index_end(void)
+{
+	if (fclose(private.file))
+		die("Failed to write \"%s\": %s", params.index, strerror(errno));
+	private.file = NULL;
+}
+
+/*
+ * Reverse mode: move "input" to the last indexed line at or before byte
+ * "skip" of the decoded output.
+ *
+ * return number of bytes still to skip from there.
+ */
+uint_fast64_t
+index_seek(FILE *input, uint_fast64_t skip)
+{
+	char magic[sizeof(MAGIC)], head[sizeof(HEADER)-1];
+	uint_fast64_t stride, offset, position, found = 0, pos = 0, header;
+	FILE *f;
+
+	if (!(f = fopen(params.index, "r")))
+		die("Failed to open \"%s\": %s", params.index, strerror(errno));
+	if (!fgets(magic, sizeof(magic), f) || strcmp(magic, MAGIC)
+			|| fscanf(f, "stride %"SCNuFAST64" header %"SCNuFAST64" ",
+				&stride, &header) != 2)
+		die("\"%s\" is not an index.", params.index);
+	while (fscanf(f, "%"SCNxFAST64" %"SCNxFAST64" ", &offset, &position) == 2
+			&& offset <= skip) {
+		found = offset;
+		pos = position;
+	}
+	fclose(f);
+
+	/* the line "Processing ..." may have been removed */
+	if (fread(head, 1, sizeof(head), input) == sizeof(head)
+			&& !memcmp(head, HEADER, sizeof(head)))
+		pos += header;
+	if (fseeko(input, pos, SEEK_SET))
+		die("option 'I' requires a seekable input in reverse mode.");
+
+	return skip-found;
+}
@@ -0,0 +1,489 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Opening of input and output files.
+ *
+ * With option "-D", files are accessed in a way that does not flood the page
+ * cache: reads/writes use O_DIRECT with aligned buffers where the file system
+ * supports it, otherwise normal reads/writes are used and the pages already
+ * processed are dropped from the cache periodically. The streams returned are
+ * stdio streams on top of our own aligned buffer (cf. fopencookie()), so the
+ * rest of ndc does not need to know about it.
+ * This is only available on Linux; other systems fall back to fopen().
+ *
+ * Standard input and output get a buffer of "-b" bytes, too. If they are
+ * pipes, they get a bigger one and the pipes themselves are enlarged, so that
+ * we do not context switch on every few kilobytes. Plain mode can hand its
+ * output blocks to an output pipe without copying them (cf. io_splice()).
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "io.h"
+#include "repository.h"
+#include "tune.h"
+#include "util.h"
+/* last */
+#include "ndc.h"
+
+
+/* minimum alignment and size of the buffers for O_DIRECT */
+#define DIRECT_ALIGN      4096
+#define DIRECT_BUFSIZE    (1 << 20)
+/* drop pages from the page cache after this many bytes (buffered fallback) */
+#define DONTNEED_INTERVAL (32 << 20)
+/* capacity we ask for (and bufsize we use) for pipes */
+#define PIPE_BUFSIZE      (1 << 20)
+
+
+#if defined(__linux__)
+/*
+ * buf        aligned buffer of "size" bytes
+ * pos, len   current position in and filling level of "buf"
+ * offset     file offset of the start of "buf" (output: of the next write)
+ * dropped    file offset up to which the pages have been dropped
+ * fd         file descriptor
+ * direct     whether O_DIRECT is in use
+ * output     whether the file is written
+ */
+typedef struct {
+	unsigned char *buf;
+	size_t size;
+	size_t pos;
+	size_t len;
+	off_t offset;
+	off_t dropped;
+	int fd;
+	bool direct;
+	bool output;
+} Cookie;
+
+
+static size_t   align_up(size_t n, size_t align);
+static int      cookie_close(void *c);
+static ssize_t  cookie_read(void *c, char *out, size_t n);
+static ssize_t  cookie_write(void *c, const char *in, size_t n);
+static void     drop_cache(Cookie *c, off_t end, bool force);
+static bool     flush_buffer(Cookie *c, bool last);
+static FILE    *open_direct(const char *path, bool output);
+static ssize_t  read_full(Cookie *c, unsigned char *out, size_t n);
+#endif
+static bool     is_pipe(FILE *f);
+
+
+/*
+ * stdin_buf, stdout_buf   buffers of standard input and output
+ */
+static char *stdin_buf, *stdout_buf;
+
+
+/*
+ * Size of the chunks we read/write for the file "path" (or stdin if NULL):
+ * "-b" if given, otherwise the one of the host profile (cf. tune.c) or
+ * auto-tuned from the preferred I/O size of the file (or the capacity we give
+ * to pipes).
+ * Direct I/O needs bigger (and aligned) chunks.
+ */
+size_t
+io_bufsize(const char *path)
+{
+	struct stat st;
+	size_t size = params.bufsize, tuned;
+
+	if (!size) {
+		size = BUFSIZ;
+		if (!(path ? stat(path, &st) : fstat(0, &st))) {
+			if (S_ISFIFO(st.st_mode))
+				size = PIPE_BUFSIZE;
+			else if (st.st_blksize > 0 && (size_t)st.st_blksize > size)
+				size = st.st_blksize;
+			if ((tuned = tune_bufsize(S_ISFIFO(st.st_mode)
+							|| S_ISSOCK(st.st_mode))))
+				size = tuned;
+		}
+	}
+
+#if defined(__linux__)
+	if (params.direct)
+		size = align_up(size < DIRECT_BUFSIZE ? DIRECT_BUFSIZE : size,
+				DIRECT_ALIGN);
+#endif
+
+	return size;
+}
+
+/*
+ * Flush and close standard input and output, cf. io_setup_std().
+ *
+ * return false if stdout could not be written.
+ */
+bool
+io_close_std(void)
+{
+	bool success = true;
+
+	if (fclose(stdout)) {
+		err("error writing stdout.");
+		success = false;
+	}
+	fclose(stdin);
+
+	free(stdin_buf);
+	free(stdout_buf);
+
+	return success;
+}
+
+/* open "path" for reading or for appending */
+FILE *
+io_open(const char *path, bool output)
+{
+#if defined(__linux__)
+	if (params.direct)
+		return open_direct(path, output);
+#endif
+	return fopen(path, output ? "ab" : "rb");
+}
+
+/*
+ * Give standard input and output buffers of the right size (and make pipes
+ * bigger). Must be called before any I/O on them.
+ */
+void
+io_setup_std(void)
+{
+	size_t size = io_bufsize(NULL);
+
+#if defined(__linux__)
+	if (is_pipe(stdin))
+		fcntl(fileno(stdin), F_SETPIPE_SZ, PIPE_BUFSIZE);
+	if (is_pipe(stdout))
+		fcntl(fileno(stdout), F_SETPIPE_SZ, PIPE_BUFSIZE);
+#endif
+
+	stdin_buf = _malloc(size);
+	if (setvbuf(stdin, stdin_buf, _IOFBF, size))
+		die("setvbuf: %s", strerror(errno));
+
+	/* the size of the input does not tell us much about the output */
+	if (!params.bufsize && is_pipe(stdout) && size < PIPE_BUFSIZE)
+		size = PIPE_BUFSIZE;
+	stdout_buf = _malloc(size);
+	if (setvbuf(stdout, stdout_buf, _IOFBF, size))
+		die("setvbuf: %s", strerror(errno));
+}
+
+/*
+ * Write "n" bytes from "buf" to the pipe "f" (cf. io_splice_size()) without
+ * copying them. The pipe keeps referencing "buf" until the data has been
+ * read, so the caller must not modify "buf" before at least
+ * io_splice_size() more bytes have been written to the pipe.
+ *
+ * return true on success.
+ */
+bool
+io_splice(FILE *f, const char *buf, size_t n)
+{
+#if defined(__linux__)
+	struct iovec iov;
+	ssize_t r;
+
+	/* keep the order with data written by stdio */
+	if (fflush(f))
+		return false;
+
+	iov.iov_base = (void *)buf;
+	iov.iov_len = n;
+	while (iov.iov_len) {
+		if ((r = vmsplice(fileno(f), &iov, 1, 0)) < 0 && errno == EINTR)
+			continue;
+		else if (r < 0)
+			return fwrite(iov.iov_base, 1, iov.iov_len, f) == iov.iov_len;
+		iov.iov_base = (char *)iov.iov_base+r;
+		iov.iov_len -= r;
+	}
+
+	return true;
+#else
+	return fwrite(buf, 1, n, f) == n;
+#endif
+}
+
+/*
+ * return the capacity of the pipe "f" if we can use io_splice() on it,
+ * 0 otherwise.
+ */
+size_t
+io_splice_size(FILE *f)
+{
+#if defined(__linux__)
+	int size;
+
+	if (!is_pipe(f) || fflush(f)
+			|| (size = fcntl(fileno(f), F_GETPIPE_SZ)) <= 0)
+		return 0;
+
+	return size;
+#else
+	(void)f;
+	return 0;
+#endif
+}
+
+bool
+is_pipe(FILE *f)
+{
+	struct stat st;
+	int fd;
+
+	return (fd = fileno(f)) >= 0 && !fstat(fd, &st) && S_ISFIFO(st.st_mode);
+}
+
+#if defined(__linux__)
+size_t
+align_up(size_t n, size_t align)
+{
+	return (n+align-1)/align*align;
+}
+
+int
+cookie_close(void *cookie)
+{
+	Cookie *c = cookie;
+	int ret = 0;
+
+	if (c->output && c->len && !flush_buffer(c, true))
+		ret = EOF;
+	drop_cache(c, c->offset+c->len, true);
+	if (close(c->fd))
+		ret = EOF;
+
+	free(c->buf);
+	free(c);
+
+	return ret;
+}
+
+/*
+ * Serve "n" bytes from the buffer. Requests big enough and suitably aligned
+ * for O_DIRECT bypass the buffer.
+ */
+ssize_t
+cookie_read(void *cookie, char *out, size_t n)
+{
+	Cookie *c = cookie;
+	ssize_t r;
+
+	if (c->pos == c->len) {
+		if (n >= c->size && !((uintptr_t)out % DIRECT_ALIGN)) {
+			r = read_full(c, (unsigned char *)out,
+					n/DIRECT_ALIGN*DIRECT_ALIGN);
+			if (r > 0) {
+				c->offset += r;
+				drop_cache(c, c->offset, false);
+			}
+			return r;
+		}
+		c->offset += c->len;
+		c->pos = 0;
+		if ((r = read_full(c, c->buf, c->size)) <= 0) {
+			c->len = 0;
+			return r;
+		}
+		c->len = r;
+		drop_cache(c, c->offset, false);
+	}
+
+	if (n > c->len-c->pos)
+		n = c->len-c->pos;
+	memcpy(out, c->buf+c->pos, n);
+	c->pos += n;
+
+	return n;
+}
+
+ssize_t
+cookie_write(void *cookie, const char *in, size_t n)
+{
+	Cookie *c = cookie;
+	size_t fill, done = 0;
+
+	while (done < n) {
+		fill = c->size-c->len < n-done ? c->size-c->len : n-done;
+		memcpy(c->buf+c->len, in+done, fill);
+		c->len += fill;
+		done += fill;
+		if (c->len == c->size && !flush_buffer(c, false))
+			return -1;
+	}
+
+	return n;
+}
+
+/*
+ * Drop the pages up to "end" from the page cache if we have processed enough
+ * since the last time (or if "force" is set). Dirty pages have to be written
+ * back first. Nothing to do for O_DIRECT.
+ */
+void
+drop_cache(Cookie *c, off_t end, bool force)
+{
+	if (c->direct || end <= c->dropped
+			|| (!force && end-c->dropped < DONTNEED_INTERVAL))
+		return;
+
+	if (c->output)
+		sync_file_range(c->fd, c->dropped, end-c->dropped,
+				SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE
+				| SYNC_FILE_RANGE_WAIT_AFTER);
+	posix_fadvise(c->fd, c->dropped, end-c->dropped, POSIX_FADV_DONTNEED);
+	c->dropped = end;
+}
+
+/*
+ * Write the buffer. O_DIRECT can only write whole blocks, so the last
+ * (partial) one is written without it.
+ */
+bool
+flush_buffer(Cookie *c, bool last)
+{
+	size_t done = 0;
+	ssize_t r;
+
+	if (last && c->direct && c->len % DIRECT_ALIGN) {
+		fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL) & ~O_DIRECT);
+		c->direct = false;
+	}
+	while (done < c->len) {
+		if ((r = write(c->fd, c->buf+done, c->len-done)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		done += r;
+	}
+	c->offset += c->len;
+	c->len = 0;
+	drop_cache(c, c->offset, false);
+
+	return true;
+}
+
+/*
+ * Open "path" with O_DIRECT if possible. Otherwise, fall back to buffered
+ * I/O, which will be told to read ahead and to drop the pages we are done
+ * with (cf. drop_cache()).
+ * Output files are only written with O_DIRECT if they end on a block
+ * boundary, as we append to them.
+ */
+FILE *
+open_direct(const char *path, bool output)
+{
+	static const cookie_io_functions_t io = {
+		.read = cookie_read,
+		.write = cookie_write,
+		.seek = NULL,
+		.close = cookie_close,
+	};
+	struct stat st;
+	Cookie *c;
+	FILE *f;
+	int flags, fd;
+
+	flags = output ? O_WRONLY | O_CREAT | O_APPEND : O_RDONLY;
+	if ((fd = open(path, flags, 0666)) < 0)
+		return NULL;
+
+	c = _calloc(1, sizeof(*c));
+	c->fd = fd;
+	c->output = output;
+	c->size = io_bufsize(path);
+	if (posix_memalign((void **)&c->buf, DIRECT_ALIGN, c->size))
+		die("posix_memalign: %s", strerror(errno));
+
+	if (!fstat(fd, &st) && output)
+		c->offset = c->dropped = st.st_size;
+
+	if ((!output || !(c->offset % DIRECT_ALIGN))
+			&& !fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_DIRECT))
+		c->direct = true;
+	else
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	if (!(f = fopencookie(c, output ? "ab" : "rb", io))) {
+		close(fd);
+		free(c->buf);
+		free(c);
+		return NULL;
+	}
+	setvbuf(f, NULL, _IOFBF, c->size);
+
+	return f;
+}
+
+/*
+ * read() until "n" bytes or EOF. If O_DIRECT turns out not to be supported
+ * for reading (EINVAL), switch to buffered reads.
+ */
+ssize_t
+read_full(Cookie *c, unsigned char *out, size_t n)
+{
+	size_t done = 0;
+	ssize_t r;
+
+	while (done < n) {
+		r = read(c->fd, out+done, n-done);
+		if (r < 0 && errno == EINVAL && c->direct) {
+			fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL) & ~O_DIRECT);
+			posix_fadvise(c->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+			c->direct = false;
+			continue;
+		} else if (r < 0 && errno == EINTR) {
+			continue;
+		} else if (r < 0) {
+			return done ? (ssize_t)done : -1;
+		} else if (!r) {
+			break;
+		}
+		done += r;
+		/* with O_DIRECT, a short read means EOF (or an unaligned rest) */
+		if (c->direct && done % DIRECT_ALIGN)
+			break;
+	}
+
+	return done;
+}
+#endif
@@ -0,0 +1,33 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef IO_H
+#define IO_H
+
+
+size_t  io_bufsize(const char *path);
+bool    io_close_std(void);
+FILE   *io_open(const char *path, bool output);
+void    io_setup_std(void);
+bool    io_splice(FILE *f, const char *buf, size_t n);
+size_t  io_splice_size(FILE *f);
+
+
+#endif /* IO_H */
@@ -0,0 +1,272 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Memory mode (option "-M PID[:RANGES]"): dump the address space of a running
+ * process instead of a file, with the virtual addresses as offsets. RANGES is
+ * a comma-separated list of "START-END" (hex, END excluded); without it, every
+ * readable mapping of /proc/PID/maps is dumped.
+ *
+ * The memory is read with process_vm_readv() in chunks of "bufsize" bytes (no
+ * ptrace stop, the process keeps running) through a stdio stream, so the usual
+ * dump() does the rest. Every chunk is one call with one remote iovec per
+ * page, as a call fails completely if a fault occurs within an iovec. Pages
+ * which cannot be read end the dump of the current run of pages; the dump
+ * continues with the next readable page after a line "--", as between two
+ * ranges.
+ *
+ * This is only available on Linux.
+ */
+
+#if defined(__linux__)
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__linux__)
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "memory.h"
+#include "repository.h"
+#include "util.h"
+/* last */
+#include "ndc.h"
+
+
+#if defined(__linux__)
+/* maximum number of pages per process_vm_readv() */
+#define PAGES_MAX  1024
+
+
+/*
+ * pid    process to read from
+ * addr   address of the next byte to read
+ * end    end of the range
+ * error  errno of the failed read, 0 = none
+ */
+typedef struct {
+	pid_t pid;
+	uint_fast64_t addr;
+	uint_fast64_t end;
+	int error;
+} Cookie;
+
+
+/* size of a page and a buffer of that size for probe() */
+static uint_fast64_t page;
+static char *probe_buf;
+
+
+static bool     dump_range(FILE *output, pid_t pid, uint_fast64_t start,
+		uint_fast64_t end, bool *first);
+static ssize_t  memory_read(void *cookie, char *buf, size_t size);
+static int      probe(pid_t pid, uint_fast64_t addr);
+static ssize_t  read_pages(pid_t pid, uint_fast64_t addr, char *buf,
+		size_t size);
+
+
+bool
+dump_memory(FILE *output)
+{
+	char *spec, *ranges, *line = NULL, path[64], perms[8];
+	uint_fast64_t start, end;
+	size_t cap = 0;
+	bool first = true, success = true;
+	FILE *maps;
+	pid_t pid;
+
+	page = sysconf(_SC_PAGESIZE);
+	if (!(pid = strtol(params.memory, &ranges, 10)) || (*ranges
+				&& *ranges != ':'))
+		die("option 'M' -- invalid process id: %s", params.memory);
+
+	fprintf(output, "Processing process %ld ...\n", (long)pid);
+	probe_buf = _malloc(page);
+
+	if (*ranges) {
+		for (spec = ranges+1; success && *spec; spec += *spec == ',') {
+			if (sscanf(spec, "%"SCNxFAST64"-%"SCNxFAST64, &start,
+						&end) != 2 || end < start)
+				die("option 'M' -- invalid range: %s", spec);
+			spec += strcspn(spec, ",");
+			success = dump_range(output, pid, start, end, &first);
+		}
+	} else {
+		snprintf(path, sizeof(path), "/proc/%ld/maps", (long)pid);
+		if ((maps = fopen(path, "r"))) {
+			while (success && getline(&line, &cap, maps) > 0) {
+				if (sscanf(line, "%"SCNxFAST64"-%"SCNxFAST64" %7s",
+							&start, &end, perms) == 3
+						&& perms[0] == 'r')
+					success = dump_range(output, pid, start,
+							end, &first);
+			}
+			free(line);
+			fclose(maps);
+		} else {
+			err("Failed to open \"%s\": %s", path, strerror(errno));
+			success = false;
+		}
+	}
+
+	/* clear used memory */
+	memset(probe_buf, 0, page);
+	free(probe_buf);
+	probe_buf = NULL;
+
+	return success;
+}
+
+/*
+ * Dump the readable parts of [start, end), each of them preceded by "--"
+ * unless it is the "first" one.
+ *
+ * return false if the process cannot be read at all or the output cannot be
+ * written.
+ */
+bool
+dump_range(FILE *output, pid_t pid, uint_fast64_t start, uint_fast64_t end,
+		bool *first)
+{
+	static const cookie_io_functions_t io = {
+		.read = memory_read,
+		.write = NULL,
+		.seek = NULL,
+		.close = NULL,
+	};
+	Cookie c = { pid, start, end, 0 };
+	FILE *f;
+	int e;
+
+	while (c.addr < end) {
+		if ((e = probe(pid, c.addr)) == ESRCH || e == EPERM) {
+			err("Failed to read process %ld: %s", (long)pid,
+					strerror(e));
+			return false;
+		} else if (e) {
+			/* skip to the next page */
+			c.addr = (c.addr/page+1)*page;
+			continue;
+		}
+
+		if (!(f = fopencookie(&c, "rb", io)))
+			die("fopencookie: %s", strerror(errno));
+		setvbuf(f, NULL, _IOFBF, bufsize);
+
+		if (!*first)
+			fputs("--\n", output);
+		*first = false;
+
+		params.base = start = c.addr;
+		c.error = 0;
+		if (!dump(f, output) || ferror(output)) {
+			fclose(f);
+			return false;
+		}
+		fclose(f);
+
+		/* cannot happen, but make sure we do not loop forever */
+		if (c.addr == start)
+			c.addr = (c.addr/page+1)*page;
+	}
+
+	return true;
+}
+
+/*
+ * Read up to "size" bytes at the address of the cookie. A page which cannot
+ * be read counts as the end of the stream.
+ */
+ssize_t
+memory_read(void *cookie, char *buf, size_t size)
+{
+	Cookie *c = cookie;
+	ssize_t r;
+
+	if (size > c->end-c->addr)
+		size = c->end-c->addr;
+	if (!size || c->error)
+		return 0;
+
+	if ((r = read_pages(c->pid, c->addr, buf, size)) <= 0) {
+		c->error = r ? errno : EFAULT;
+		return 0;
+	}
+	c->addr += r;
+
+	return r;
+}
+
+/*
+ * return 0 if the rest of the page of "addr" can be read, errno otherwise.
+ */
+int
+probe(pid_t pid, uint_fast64_t addr)
+{
+	return read_pages(pid, addr, probe_buf, page-addr%page) > 0 ? 0 : errno;
+}
+
+/*
+ * Read "size" bytes at "addr" of process "pid" to "buf" (but not more than
+ * PAGES_MAX pages).
+ *
+ * return number of bytes read up to the first page which cannot be read, -1
+ * if not even the first one can be read.
+ */
+ssize_t
+read_pages(pid_t pid, uint_fast64_t addr, char *buf, size_t size)
+{
+	struct iovec local, remote[PAGES_MAX];
+	unsigned long n;
+	size_t len;
+
+	local.iov_base = buf;
+	local.iov_len = 0;
+	for (n = 0; size && n < PAGES_MAX; n++) {
+		len = page-addr%page;
+		if (len > size)
+			len = size;
+		remote[n].iov_base = (void *)(uintptr_t)addr;
+		remote[n].iov_len = len;
+		local.iov_len += len;
+		addr += len;
+		size -= len;
+	}
+
+	return process_vm_readv(pid, &local, 1, remote, n, 0);
+}
+#else
+bool
+dump_memory(FILE *output)
+{
+	(void)output;
+	err("Reading the memory of processes is only supported on Linux.");
+	return false;
+}
+#endif
@@ -0,0 +1,313 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Several representations in one pass (option "-T TYPE:FILE", may be given
+ * multiple times): besides the dump of type "-t" to standard output (or
+ * "-d"), the input is dumped as TYPE to FILE. The input is read only once;
+ * every chunk of it is handed to the formatter of every representation, each of
+ * them with its own type, lookup table, last line and output. With "-j", the
+ * representations are formatted and written in parallel threads, started
+ * once per file, which wait for every chunk and report back when they are
+ * done with it.
+ *
+ * The output of every representation is the same as the one of a separate
+ * run with "-t TYPE -d FILE".
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "checksum.h"
+#include "format.h"
+#include "io.h"
+#include "multi.h"
+#include "progress.h"
+#include "repository.h"
+#include "util.h"
+/* last */
+#include "ndc.h"
+
+
+/*
+ * fmt       formatter of this representation (type, lookup table, last line)
+ * output    where to write to
+ * out       formatted lines of the current chunk
+ * out_size  size of "out"
+ */
+typedef struct {
+	Formatter fmt;
+	FILE *output;
+	char *out;
+	size_t out_size;
+} Representation;
+
+/*
+ * in       current chunk of "n" bytes, to be formatted by every thread
+ * offset   offset of the first byte of "in"
+ * round    number of the current chunk, incremented to hand it to the threads
+ * busy     number of threads still formatting the current chunk
+ * stop     whether the threads have to stop
+ * lock     protects all of the above
+ * cond     signals changes of "round", "busy" and "stop"
+ */
+typedef struct {
+	const unsigned char *in;
+	size_t n;
+	uint_fast64_t offset;
+	uint_fast64_t round;
+	unsigned busy;
+	bool stop;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} Job;
+
+
+static void   format(Representation *r, const unsigned char *in, size_t n,
+		uint_fast64_t offset);
+static void  *format_thread(void *arg);
+
+
+/*
+ * rep    every representation, the first one being "-t"
+ * count  number of representations
+ * job    chunk handed to the threads of the representations with "-j"
+ */
+static Representation  rep[MULTI_MAX+1];
+static unsigned        count;
+static Job             job = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+
+bool
+dump_multi(FILE *input, FILE *output, const char *name)
+{
+	pthread_t threads[MULTI_MAX];
+	unsigned char *in;
+	char *out;
+	uint_fast64_t offset = params.skip, processed = 0;
+	size_t chunk, n, size;
+	unsigned i, opened;
+	const char *file;
+	bool success = true, parallel = params.jobs > 1 && count > 1;
+
+	/* the additional outputs are opened like "-d" */
+	for (opened = 1; opened < count; opened++) {
+		file = strchr(params.multi_spec[opened-1], ':')+1;
+		if (!(rep[opened].output = io_open(file, true))) {
+			err("Failed to open \"%s\": %s", file, strerror(errno));
+			success = false;
+			goto close;
+		}
+		fprintf(rep[opened].output, "Processing %s ...\n", name);
+	}
+	rep[0].output = output;
+
+	if (skip_offset(input) == EOF) {
+		for (i = 0; i < count; i++)
+			fprintf(rep[i].output, "EOF reached after skipping %"
+					SCNuFAST64" bytes.\n", params.skip);
+		goto close;
+	}
+
+	/* whole lines, so that chunks do not split them */
+	chunk = bufsize/params.width ? bufsize/params.width*params.width
+		: params.width;
+	in = arena_block(ARENA_IN, chunk);
+	/* the output blocks of the representations follow each other */
+	for (size = 0, i = 0; i < count; i++) {
+		rep[i].out_size = format_size(&rep[i].fmt, chunk);
+		size += rep[i].out_size;
+	}
+	out = arena_block(ARENA_OUT, size);
+	for (i = 0; i < count; i++) {
+		rep[i].out = out;
+		out += rep[i].out_size;
+		rep[i].fmt.masked = false;
+		rep[i].fmt.written = false;
+	}
+
+	/* the first representation is formatted by this thread */
+	if (parallel) {
+		job.round = 0;
+		job.stop = false;
+		for (i = 1; i < count; i++) {
+			if (pthread_create(&threads[i-1], NULL, format_thread,
+						&rep[i]))
+				die("pthread_create: %s", strerror(errno));
+		}
+	}
+
+	for (;;) {
+		n = chunk;
+		if (params.limited && params.limit-processed < n)
+			n = params.limit-processed;
+		if (!n || !(n = fread(in, 1, n, input)))
+			break;
+		if (params.checksum)
+			checksum_update(in, n);
+		if (progress_due)
+			progress_report(processed+n);
+
+		if (parallel) {
+			pthread_mutex_lock(&job.lock);
+			job.in = in;
+			job.n = n;
+			job.offset = offset;
+			job.busy = count-1;
+			job.round++;
+			pthread_cond_broadcast(&job.cond);
+			pthread_mutex_unlock(&job.lock);
+
+			format(&rep[0], in, n, offset);
+
+			pthread_mutex_lock(&job.lock);
+			while (job.busy)
+				pthread_cond_wait(&job.cond, &job.lock);
+			pthread_mutex_unlock(&job.lock);
+		} else {
+			for (i = 0; i < count; i++)
+				format(&rep[i], in, n, offset);
+		}
+
+		offset += n;
+		processed += n;
+	}
+	if (parallel) {
+		pthread_mutex_lock(&job.lock);
+		job.stop = true;
+		pthread_cond_broadcast(&job.cond);
+		pthread_mutex_unlock(&job.lock);
+		for (i = 1; i < count; i++)
+			pthread_join(threads[i-1], NULL);
+	}
+	if (ferror(input))
+		success = false;
+	progress_end(processed);
+
+	for (i = 0; i < count; i++) {
+		format_last_offset(rep[i].output, offset,
+				!i && params.checksum);
+
+		/* clear used memory */
+		memset(rep[i].out, 0, rep[i].out_size);
+	}
+	memset(in, 0, chunk);
+	/* the blocks are kept for the next file, cf. arena.c */
+
+close:
+	for (i = 1; i < opened; i++) {
+		if (fclose(rep[i].output))
+			success = false;
+	}
+
+	return success;
+}
+
+/* format the "n" bytes of "in" for "r" and write them */
+void
+format(Representation *r, const unsigned char *in, size_t n,
+		uint_fast64_t offset)
+{
+	char *end = format_lines(&r->fmt, r->out, in, n, offset);
+
+	fwrite(r->out, 1, end-r->out, r->output);
+}
+
+/* thread function: format every chunk of "job" for the representation "arg" */
+void *
+format_thread(void *arg)
+{
+	Representation *r = arg;
+	uint_fast64_t round = 0;
+
+	pthread_mutex_lock(&job.lock);
+	for (;;) {
+		while (job.round == round && !job.stop)
+			pthread_cond_wait(&job.cond, &job.lock);
+		if (job.stop)
+			break;
+		round = job.round;
+		pthread_mutex_unlock(&job.lock);
+
+		format(r, job.in, job.n, job.offset);
+
+		pthread_mutex_lock(&job.lock);
+		if (!--job.busy)
+			pthread_cond_broadcast(&job.cond);
+	}
+	pthread_mutex_unlock(&job.lock);
+
+	return NULL;
+}
+
+/* build the lookup table of "-t" and of every "-T", cf. format_table() */
+void
+init_multi(void)
+{
+	Repository saved = type;
+	char * (*saved_conv)(char *, const unsigned char *, unsigned) =
+		byte_to_numeric;
+	char name[16];
+	size_t len;
+
+	for (count = 0; count <= params.multi; count++) {
+		if (count) {
+			len = strcspn(params.multi_spec[count-1], ":");
+			if (len >= sizeof(name))
+				len = sizeof(name)-1;
+			memcpy(name, params.multi_spec[count-1], len);
+			name[len] = '\0';
+			if (!set_type(name))
+				die("option 'T' -- unsupported type: %s", name);
+			init_type();
+		}
+
+		format_clean(&rep[count].fmt);
+		format_init(&rep[count].fmt, NULL, NULL);
+	}
+
+	type = saved;
+	byte_to_numeric = saved_conv;
+}
+
+/* free the lookup tables and last lines of init_multi() */
+void
+multi_clean(void)
+{
+	unsigned i;
+
+	for (i = 0; i < count; i++)
+		format_clean(&rep[i].fmt);
+	count = 0;
+}
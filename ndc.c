@@ -18,20 +18,43 @@
  * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <errno.h>
 #include <inttypes.h>
 #include <limits.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include "analysis.h"
+#include "arena.h"
+#include "cache.h"
+#include "checkpoint.h"
+#include "checksum.h"
+#include "compress.h"
 #include "config.h"
+#include "dictionary.h"
 #include "DumpState.h"
+#include "foreign.h"
+#include "index.h"
+#include "io.h"
 #include "libgetopt_portable/libgetopt_portable.h"
+#include "memory.h"
+#include "multi.h"
+#include "parallel.h"
+#include "patch.h"
+#include "plain.h"
+#include "progress.h"
 #include "repository_definition.h"
+#include "sample.h"
+#include "server.h"
+#include "tune.h"
 #include "util.h"
 /* last */
 #include "ndc.h"
@@ -41,15 +64,18 @@ static char        *byte_to_numeric_not_power_of_two(
 		char *out, const unsigned char *in, unsigned n);
 static char        *byte_to_numeric_power_of_two(
 		char *out, const unsigned char *in, unsigned n);
-static bool         dump(FILE *input, FILE *output);
-static bool         dump_reverse(FILE *input, FILE *output);
+static bool         dump_reverse(FILE *input, FILE *output,
+		const char *head, size_t head_len);
+static bool         expand_reference(FILE *input, FILE *output,
+		uint_fast64_t *skip, uint_fast64_t *byte_count);
 static void         init(void);
 static void         limits(void);
 static inline void  numeric_to_byte(
 		unsigned char *out, const char *in, unsigned len);
-static void         process(const char *infile, const char *outfile);
-static bool         set_type(const char *name);
-static int          skip_offset(FILE *f);
+static unsigned     offset_length(const char *infile);
+static bool         process(const char *infile, const char *outfile);
+static bool         put_byte(unsigned char b, FILE *output,
+		uint_fast64_t *skip, uint_fast64_t *byte_count);
 static void         usage(void);
 static void         version(void);
 
@@ -57,21 +83,57 @@ static void         version(void);
 /* 
  * global variables (cf. config.h, too):
  *
- * params    command line parameters
- * type      type of numeric conversion
+ * bufsize     size of the chunks we read/write for the current file
+ * offset_len  length of the offset column of the current file (including the
+ *               two spaces), cf. offset_length()
+ * params      command line parameters
+ * type        type of numeric conversion
  */
-/* define "params", declared in "ndc.h" */
-Params params = {
+/* define "bufsize", declared in "ndc.h" */
+size_t bufsize = BUFSIZ;
+/* define "offset_len", declared in "ndc.h" */
+unsigned offset_len = OFFSET_CHAR_LEN;
+/* defaults of "params", cf. parse_options() */
+static const Params default_params = {
+	.analysis = 0,
 	.ascii_col = false,
-	.bufsize = BUFSIZ,
+	.base = 0,
+	.bufsize = 0,
+	.calibrate = false,
+	.cache = NULL,
+	.checkpoint = NULL,
+	.checksum = 0,
+	.client = NULL,
+	.compress = 0,
+	.dictionary = 0,
+	.direct = false,
+	.fit_offset = false,
 	.full = false,
+	.index = NULL,
+	.index_stride = 0,
+	.jobs = 1,
 	.limit = 0,
 	.limited = false,
+	.memory = NULL,
+	.multi = 0,
+	.multi_spec = { NULL },
 	.offset = true,
+	.outfile = NULL,
+	.parallel_jobs = 1,
+	.patch = NULL,
+	.plain = false,
+	.progress = 0,
+	.resume = false,
 	.reverse = false,
+	.sample = 0,
+	.sample_count = 0,
+	.sample_seed = 0,
+	.server = NULL,
 	.skip = 0,
 	.width = 16
 };
+/* define "params", declared in "ndc.h" */
+Params params;
 /* define "type", declared in "ndc.h" */
 Repository type = no_repo;
 /* define "byte_to_numeric", declared in "ndc.h" */
@@ -157,6 +219,26 @@ byte_to_numeric_power_of_two(char *out, const unsigned char *in, unsigned n)
 	return type.space ? out-1 : out;
 }
 
+/*
+ * Add "n" to the offset written to "out" by get_offset() like a counter, i.e.
+ * rewrite only the digits that change.
+ */
+void
+count_offset(char *out, uint_fast64_t n)
+{
+	unsigned d, i = offset_len-2;
+
+	while (n && i--) {
+		d = (out[i] <= '9' ? out[i]-'0' : out[i]-'A'+10) + (n & 0xf);
+		n >>= 4;
+		if (d > 0xf) {
+			d -= 0x10;
+			n++;
+		}
+		out[i] = repo[HEX_UC].characters[d];
+	}
+}
+
 /*
  * May be called multiple times if there are multiple files to process.
  *
@@ -172,17 +254,21 @@ byte_to_numeric_power_of_two(char *out, const unsigned char *in, unsigned n)
 bool
 dump(FILE *input, FILE *output)
 {
-	if (skip_offset(input) == EOF) {
+	if (!params.resume && skip_offset(input) == EOF) {
 		fprintf(output, "EOF reached after skipping %"SCNuFAST64" bytes.\n",
 				params.skip);
 		return true;
 	}
 
 	ds.init(&ds, input, output);
+	if (params.resume)
+		ds.restore(&ds);
 
 	for (;;) {
 		do {
 			ds.read(&ds);
+			if (ds.masked && params.checkpoint)
+				ds.checkpoint(&ds);
 		} while (ds.masked);
 		if (ds.finished)
 			break;
@@ -198,10 +284,14 @@ dump(FILE *input, FILE *output)
 			ds.append_newline();
 
 		ds.write();
+		if (params.checkpoint)
+			ds.checkpoint(&ds);
 	}
 	/* do not forget to add the previously read number of bytes to offset */
 	if (params.offset)
 		ds.print_last_offset();
+	else if (params.checksum)
+		checksum_print(output);
 
 	ds.clean();
 
@@ -212,78 +302,144 @@ dump(FILE *input, FILE *output)
  * Convert a string like "FF" to its byte value.
  * Try to handle incomplete numbers as if there were leading zeros (e.g.
  * consider "F" as "0F").
+ * Back-references ("@POS+LEN", cf. dictionary.c) are expanded if "-m" is
+ * given.
+ * Checkpoints ("-k") are made between two complete bytes.
+ * The "head_len" characters of "head" are read before "input" (the first
+ * line, if it could not be given back, cf. foreign_detect()).
  * May be called multiple times if there are multiple files to process.
  */
 bool
-dump_reverse(FILE *input, FILE *output)
+dump_reverse(FILE *input, FILE *output, const char *head, size_t head_len)
 {
+	FILE *in_file = input;
 	char ch, *in, *ptr;
-	uint_fast64_t byte_count = 0, skip = params.skip;
+	uint_fast64_t byte_count = 0, pos = 0, report = 0, skip = params.skip;
 	unsigned char out, count = 0;
+	bool more = true;
+
+	in = arena_block(ARENA_DIGITS, type.char_width);
+	if (params.dictionary)
+		dictionary_init();
+	if (params.resume) {
+		pos = checkpoint.input;
+		skip = checkpoint.skip;
+		byte_count = checkpoint.byte_count;
+	}
+	if (params.index)
+		skip = index_seek(input, skip);
 
-	in = _malloc(type.char_width);
+	if (head_len && !(in_file = fmemopen((void *)head, head_len, "r")))
+		die("fmemopen: %s", strerror(errno));
 
-	while (fread(&ch, 1, 1, input)) {
+	while (more) {
+		if (!fread(&ch, 1, 1, in_file)) {
+			if (in_file == input)
+				break;
+			fclose(in_file);
+			in_file = input;
+			continue;
+		}
+		/* once per "bufsize" characters, cf. progress.c */
+		if (pos++ >= report) {
+			report = pos+bufsize;
+			if (progress_due)
+				progress_report(pos);
+		}
 		if ((ptr = strchr(type.characters, ch))) {
 			in[count++] = ptr-type.characters;
 			if (count != type.char_width)
 				continue;
+		} else if (ch == '@' && params.dictionary) {
+			if (count) {
+				numeric_to_byte(&out, in, count);
+				more = put_byte(out, output, &skip, &byte_count);
+				count = 0;
+			}
+			if (more)
+				more = expand_reference(in_file, output, &skip,
+						&byte_count);
+			continue;
 		} else if (!strchr(skip_characters, ch) && ch) {
 			die("error: invalid character -- \"%c\".", ch);
 		} else if (!count) {
 			continue;
 		}
-		if (skip) {
-			skip--;
-			count = 0;
-			continue;
-		} else if (params.limited && byte_count++ == params.limit) {
-			break;
-		}
 		numeric_to_byte(&out, in, count);
-		fputc(out, output);
+		more = put_byte(out, output, &skip, &byte_count);
 		count = 0;
+
+		if (params.checkpoint && checkpoint_due(pos)) {
+			checkpoint.input = pos;
+			checkpoint.skip = skip;
+			checkpoint.byte_count = byte_count;
+			checkpoint_save(output);
+		}
 	}
-	if (count && !skip && (!params.limited || byte_count < params.limit)) {
+	if (count && more) {
 		numeric_to_byte(&out, in, count);
-		fputc(out, output);
+		put_byte(out, output, &skip, &byte_count);
 	}
+	if (in_file != input)
+		fclose(in_file);
+	progress_end(pos);
 
 	/* clear used memory */
 	memset(in, 0, type.char_width);
-	free(in);
+	if (params.dictionary)
+		dictionary_clean();
 
 	return ferror(input) ? false : true;
 }
 
 /*
- * Write offset - byte offset in file - in hex to the start of the string "out".
- * Append two spaces. Operate in reverse direction.
+ * Read the rest of a back-reference ("POS+LEN" after "@") and write the
+ * referenced bytes again.
+ *
+ * return false if the limit ("-l") has been reached.
+ */
+bool
+expand_reference(FILE *input, FILE *output, uint_fast64_t *skip,
+		uint_fast64_t *byte_count)
+{
+	uint_fast64_t pos;
+	unsigned i, len;
+
+	if (fscanf(input, "%"SCNxFAST64"+%x", &pos, &len) != 2)
+		die("error: invalid back-reference.");
+
+	for (i = 0; i < len; i++) {
+		if (!put_byte(history_get(pos+i), output, skip, byte_count))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * Write offset - byte offset in file - in hex to the start of the string "out"
+ * ("offset_len"-2 digits). Append two spaces. Operate in reverse direction.
  */
 void
 get_offset(char *out, uint_fast64_t byte_count)
 {
-	out += OFFSET_CHAR_LEN-1;
+	unsigned digits = offset_len-2;
+
+	out += offset_len-1;
 
 	*out-- = ' ';
 	*out-- = ' ';
 
-	for (unsigned shift = 0; shift < UINT_FAST64_T_BIT_LEN; shift += 4)
+	for (unsigned shift = 0; digits--; shift += 4)
 		*out-- = repo[HEX_UC].characters[(byte_count >> shift) & 0xf];
 }
 
 /*
- * Calculate the length of the string representations for one byte.
- * E.g: if CHAR_BIT is "8", we need max. two hex-characters or max. three
- * decimal-characters to represent the value of one byte.
- * In order to determine "char_width", we calculate the logarithm of
- * "base" to base CHAR_MAX (round up).
+ * Check the type against the mode and prepare the conversion(s).
  */
 void
 init(void)
 {
-	int a, i;
-
 	if (params.reverse && type.type == ASC)
 		die("Will not accept ASCII as input type.");
 	else if (params.reverse && type.type == NONE)
@@ -291,6 +447,27 @@ init(void)
 	else if (type.type == NONE)
 		type = repo[HEX_UC]; /* default */
 
+	init_type();
+
+	if (params.plain)
+		init_plain();
+	if (params.multi)
+		init_multi();
+}
+
+/*
+ * Calculate the length of the string representations for one byte.
+ * E.g: if CHAR_BIT is "8", we need max. two hex-characters or max. three
+ * decimal-characters to represent the value of one byte.
+ * In order to determine "char_width", we calculate the logarithm of
+ * "base" to base CHAR_MAX (round up).
+ * Choose the matching byte_to_numeric(), too.
+ */
+void
+init_type(void)
+{
+	int a, i;
+
 	if (!type.char_width) {
 		for (a = 1, i = 1; (a *= type.base) < CHAR_MAX; i++);
 		type.char_width = i;
@@ -321,53 +498,453 @@ numeric_to_byte(unsigned char *out, const char *in, unsigned len)
 		*out += *in--*base;
 }
 
+/*
+ * Length of the offset column for "infile" (stdin if NULL): with "-o", only as
+ * many digits as the last offset of a regular file needs.
+ */
+unsigned
+offset_length(const char *infile)
+{
+	struct stat st;
+	uint_fast64_t end;
+	unsigned digits;
+
+	if (!params.fit_offset || params.memory
+			|| (infile ? stat(infile, &st) : fstat(STDIN_FILENO, &st))
+			|| !S_ISREG(st.st_mode))
+		return OFFSET_CHAR_LEN;
+
+	end = st.st_size;
+	if (params.limited && end > params.skip && end-params.skip > params.limit)
+		end = params.skip+params.limit;
+	end += params.base;
+	for (digits = 1; end >>= 4; digits++);
+
+	return digits+2;
+}
+
+/*
+ * Parse the command line into "params" and "type", starting from the
+ * defaults (the server does this for every request, cf. server.c).
+ *
+ * return -1 if the files have to be processed (cf. run()) or the exit status.
+ */
+int
+parse_options(int argc, char * const *argv)
+{
+	const char *jobs_arg = NULL, *width_arg = NULL;
+	int opt;
+
+	params = default_params;
+	type = no_repo;
+	opt_ind = 1;
+
+	while ((opt = getopt_portable(argc, argv, "aAb:c:C:d:De:fg:hi:I:j:k:Kl:Lm:M:noP:prs:S:t:T:u:U:vw:z:")) != -1) {
+		switch (opt) {
+		case 'a':
+			params.ascii_col = true;
+			break;
+		case 'A':
+			params.calibrate = true;
+			break;
+		case 'b':
+			if (sscanf(opt_arg, "%zu", &params.bufsize) <= 0
+					|| !params.bufsize)
+				die("option '%c' -- invalid size: %s", opt, opt_arg);
+			break;
+		case 'c':
+			if (!(params.checksum = checksum_parse(opt_arg)))
+				die("option '%c' -- unsupported checksum: %s", opt,
+						opt_arg);
+			break;
+		case 'C':
+			params.cache = opt_arg;
+			break;
+		case 'd':
+			params.outfile = opt_arg;
+			break;
+		case 'D':
+			params.direct = true;
+			break;
+		case 'e':
+			if (strchr(opt_arg, '-')
+					|| sscanf(opt_arg, "%"SCNuFAST64, &params.analysis) <= 0
+					|| !params.analysis)
+				die("option '%c' -- invalid size: %s", opt, opt_arg);
+			break;
+		case 'f':
+			params.full = true;
+			break;
+		case 'g':
+			if (strchr(opt_arg, '-')
+					|| sscanf(opt_arg, "%u", &params.progress) <= 0
+					|| !params.progress)
+				die("option '%c' -- invalid size: %s", opt, opt_arg);
+			break;
+		case 'h':
+			usage();
+			return EXIT_SUCCESS;
+		case 'i':
+			if (strchr(opt_arg, '-')
+					|| sscanf(opt_arg, "%"SCNuFAST64, &params.index_stride) <= 0
+					|| !params.index_stride)
+				die("option '%c' -- invalid size: %s", opt, opt_arg);
+			break;
+		case 'I':
+			params.index = opt_arg;
+			break;
+		case 'j':
+			if (strchr(opt_arg, '-')
+					|| sscanf(opt_arg, "%u", &params.jobs) <= 0
+					|| !params.jobs)
+				die("option '%c' -- invalid size: %s", opt, opt_arg);
+			jobs_arg = opt_arg;
+			break;
+		case 'k':
+			params.checkpoint = opt_arg;
+			break;
+		case 'K':
+			params.resume = true;
+			break;
+		case 'l':
+			if (strchr(opt_arg, '-')
+					|| sscanf(opt_arg, "%"SCNuFAST64, &params.limit) <= 0)
+				die("option '%c' -- invalid size: %s", opt, opt_arg);
+			params.limited = true;
+			break;
+		case 'L':
+			limits();
+			return EXIT_SUCCESS;
+		case 'm':
+			if (strchr(opt_arg, '-')
+					|| sscanf(opt_arg, "%"SCNuFAST64, &params.dictionary) <= 0
+					|| !params.dictionary)
+				die("option '%c' -- invalid size: %s", opt, opt_arg);
+			break;
+		case 'M':
+			params.memory = opt_arg;
+			break;
+		case 'n':
+			params.offset = false;
+			break;
+		case 'o':
+			params.fit_offset = true;
+			break;
+		case 'p':
+			params.plain = true;
+			break;
+		case 'P':
+			params.patch = opt_arg;
+			break;
+		case 'r':
+			params.reverse = true;
+			break;
+		case 's':
+			if (strchr(opt_arg, '-')
+					|| sscanf(opt_arg, "%"SCNuFAST64, &params.skip) <= 0)
+				die("option '%c' -- invalid size: %s", opt, opt_arg);
+			break;
+		case 'S':
+			if (!sample_parse(opt_arg))
+				die("option '%c' -- invalid sample: %s", opt, opt_arg);
+			break;
+		case 't':
+			if (!set_type(opt_arg))
+				die("option '%c' -- unsupported type: %s", opt, opt_arg);
+			break;
+		case 'T':
+			if (params.multi == MULTI_MAX || !strchr(opt_arg, ':'))
+				die("option '%c' -- invalid argument: %s", opt,
+						opt_arg);
+			params.multi_spec[params.multi++] = opt_arg;
+			break;
+		case 'u':
+			params.client = opt_arg;
+			break;
+		case 'U':
+			params.server = opt_arg;
+			break;
+		case 'v':
+			version();
+			return EXIT_SUCCESS;
+		case 'w':
+			if (strchr(opt_arg, '-')
+					|| sscanf(opt_arg, "%u", &params.width) <= 0)
+				die("option '%c' -- invalid size: %s", opt, opt_arg);
+			width_arg = opt_arg;
+			break;
+		case 'z':
+			if (sscanf(opt_arg, "%d", &params.compress) <= 0
+					|| params.compress < 1 || params.compress > 9)
+				die("option '%c' -- invalid level: %s", opt, opt_arg);
+			break;
+		default:
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	/* the threads of the host profile, cf. tune.c */
+	params.parallel_jobs = !jobs_arg && tune_jobs() ? tune_jobs()
+		: params.jobs;
+
+	/* the width limit does only apply to the human-readable output */
+	if (params.plain && !width_arg)
+		params.width = 0;
+	else if (!params.plain && (!params.width || params.width > 256))
+		die("option 'w' -- invalid size: %s", width_arg);
+
+	if (params.calibrate && params.server)
+		die("option 'A' does not work with 'U'.");
+	if (params.analysis && (params.plain || params.reverse))
+		die("option 'e' does not work with 'p' and 'r'.");
+	if (params.sample && (params.analysis || params.checkpoint
+				|| params.dictionary || params.plain || params.reverse))
+		die("option 'S' does not work with 'e', 'k', 'm', 'p' and 'r'.");
+	if (params.multi && (params.analysis || params.checkpoint
+				|| params.dictionary || params.plain || params.reverse
+				|| params.sample))
+		die("option 'T' does not work with 'e', 'k', 'm', 'p', 'r' and "
+				"'S'.");
+	if (params.patch && (params.analysis || params.checkpoint
+				|| params.checksum || params.dictionary
+				|| params.limited || params.multi || params.outfile
+				|| params.plain || params.reverse || params.sample
+				|| params.skip))
+		die("option 'P' does not work with 'c', 'd', 'e', 'k', 'l', "
+				"'m', 'p', 'r', 's', 'S' and 'T'.");
+	if (params.memory && (opt_ind < argc || params.analysis
+				|| params.checkpoint || params.checksum
+				|| params.limited || params.multi || params.patch
+				|| params.plain || params.reverse || params.sample
+				|| params.skip))
+		die("option 'M' does not work with files and 'c', 'e', 'k', "
+				"'l', 'p', 'P', 'r', 's', 'S' and 'T'.");
+	if (params.cache && (params.analysis || params.checkpoint
+				|| params.dictionary || params.memory || params.multi
+				|| params.patch || params.plain || params.reverse
+				|| params.sample))
+		die("option 'C' does not work with 'e', 'k', 'm', 'M', 'p', "
+				"'P', 'r', 'S' and 'T'.");
+	if (params.index_stride && !params.index)
+		die("option 'i' requires option 'I'.");
+	if (params.index && (opt_ind+1 < argc || params.analysis
+				|| params.cache || params.checkpoint
+				|| params.dictionary || params.memory || params.multi
+				|| params.patch || params.plain || params.sample))
+		die("option 'I' works with one file only and does not work with "
+				"'C', 'e', 'k', 'm', 'M', 'p', 'P', 'S' and 'T'.");
+	if (params.resume && !params.checkpoint)
+		die("option 'K' requires option 'k'.");
+	if (params.checkpoint && (!params.outfile || params.analysis
+				|| params.checksum || params.dictionary
+				|| params.direct || params.plain))
+		die("option 'k' requires option 'd' and does not work with "
+				"'c', 'D', 'e', 'm' and 'p'.");
+	if (params.compress && (params.checkpoint || params.patch))
+		die("option 'z' does not work with 'k' and 'P'.");
+
+	return -1;
+}
+
 /* 
  * process files (may be called multiple times)
+ *
+ * return false on errors.
  */
-void
+bool
 process(const char *infile, const char *outfile)
 {
-	static char *inbuf, *outbuf;
-	FILE *input = stdin, *output = stdout;
+	char *inbuf = NULL, *outbuf = NULL;
+	FILE *input = stdin, *output = stdout, *raw_input, *raw_output;
+	const char *name, *head = NULL;
+	size_t head_len = 0;
+	int header = 0;
 	bool success = true;
 
-	if (infile && strcmp(infile, "-")) {
-		if (!(input = fopen(infile, "rb"))) {
+	if (infile && !strcmp(infile, "-"))
+		infile = NULL;
+	name = infile ? infile : params.memory ? params.memory : "stdin";
+	bufsize = io_bufsize(infile);
+	offset_len = offset_length(infile);
+
+	/* processed completely before the checkpoint */
+	if (params.checkpoint && !checkpoint_begin(name))
+		return true;
+
+	if (parallel_applicable(infile, outfile)) {
+		if (dump_parallel(infile, outfile))
+			return true;
+		err("error processing %s.", infile);
+		return false;
+	}
+
+	/* streams opened with "-D" are buffered by io.c */
+	if (infile) {
+		if (!(input = io_open(infile, false))) {
 			err("Failed to open \"%s\".", infile);
-			return;
+			return false;
+		}
+		if (!params.direct) {
+			inbuf = arena_block(ARENA_INBUF, bufsize);
+			if (setvbuf(input, inbuf, _IOFBF, bufsize))
+				die("setvbuf: %s", strerror(errno));
 		}
-		inbuf = _malloc(params.bufsize);
-		if (setvbuf(input, inbuf, _IOFBF, params.bufsize))
-			die("setvbuf: %s", strerror(errno));
 	}
+	/* compressed input is decompressed transparently, cf. compress.c */
+	raw_input = input;
+	if (!params.memory && !(input = compress_input(raw_input, name))) {
+		if (raw_input != stdin)
+			fclose(raw_input);
+		return false;
+	}
+	/* the size of the file does not tell the number of bytes */
+	if (input != raw_input)
+		offset_len = OFFSET_CHAR_LEN;
+	if (params.resume && !checkpoint_seek(input, checkpoint.input))
+		die("\"%s\" is shorter than at the checkpoint.", name);
 	if (outfile) {
-		if (!(output = fopen(outfile, "ab")))
+		/* drop what has been written after the checkpoint */
+		if (params.resume)
+			checkpoint_truncate(outfile);
+		if (!(output = io_open(outfile, true)))
 			die("Failed to open/create output file.");
-		outbuf = _malloc(params.bufsize);
-		if (setvbuf(output, outbuf, _IOFBF, params.bufsize))
-			die("setvbuf: %s", strerror(errno));
+		if (!params.direct) {
+			outbuf = arena_block(ARENA_OUTBUF, bufsize);
+			if (setvbuf(output, outbuf, _IOFBF, bufsize))
+				die("setvbuf: %s", strerror(errno));
+		}
 	}
+	raw_output = output;
+	if (params.compress)
+		output = compress_output(raw_output);
 
-	if (!params.reverse) {
-		fprintf(output, "Processing %s ...\n",
-				input == stdin ? "stdin" : infile);
+	if (!params.reverse && !params.plain && !params.resume
+			&& !params.patch && !params.memory) {
+		header = fprintf(output, "Processing %s ...\n", name);
 	}
+	if (params.index && !params.reverse)
+		index_begin(header);
+
+	if (params.checksum)
+		checksum_init(params.checksum);
+	progress_begin(name, params.memory ? NULL : input);
 
-	if (params.reverse)
-		success = dump_reverse(input, output);
+	if (params.analysis)
+		success = dump_analysis(input, output);
+	else if (params.memory)
+		success = dump_memory(output);
+	else if (params.patch)
+		success = dump_patch(input);
+	else if (params.plain && params.reverse)
+		success = dump_reverse_plain(input, output);
+	else if (params.plain)
+		success = dump_plain(input, output);
+	else if (params.reverse && foreign_detect(input, &head, &head_len))
+		success = dump_reverse_foreign(input, output);
+	else if (params.reverse && !head_len
+			&& reverse_parallel_applicable(input))
+		success = dump_reverse_parallel(input, output);
+	else if (params.reverse)
+		success = dump_reverse(input, output, head, head_len);
+	else if (params.sample)
+		success = dump_sample(input, output);
+	else if (params.multi)
+		success = dump_multi(input, output, name);
+	else if (params.cache)
+		success = dump_cache(input, output);
 	else
 		success = dump(input, output);
 
-	if (input != stdin) {
+	if (params.index && !params.reverse)
+		index_end();
+
+	/* keep binary and plain output clean */
+	if (params.checksum && (params.reverse || params.plain)) {
+		fprintf(stderr, "%s: ", name);
+		checksum_print(stderr);
+	}
+
+	if (input != raw_input)
 		fclose(input);
-		free(inbuf);
-	} if (output != stdout) {
-		fclose(output);
-		free(outbuf);
+	if (output != raw_output && fclose(output)) {
+		err("error writing the compressed output.");
+		success = false;
 	}
+	/* the buffers are kept for the next file, cf. arena.c */
+	if (raw_input != stdin)
+		fclose(raw_input);
+	if (raw_output != stdout)
+		fclose(raw_output);
+
+	if (params.checkpoint)
+		checkpoint_end();
 
 	if (!success)
-		err("error processing %s.", input == stdin ? "stdin" : infile);
+		err("error processing %s.", name);
+
+	return success;
+}
+
+/*
+ * Write one reconstructed byte, respecting "-s" and "-l".
+ *
+ * return false if the limit has been reached.
+ */
+bool
+put_byte(unsigned char b, FILE *output, uint_fast64_t *skip,
+		uint_fast64_t *byte_count)
+{
+	if (params.dictionary)
+		history_put(b);
+
+	if (*skip) {
+		(*skip)--;
+		return true;
+	} else if (params.limited && *byte_count == params.limit) {
+		return false;
+	}
+	(*byte_count)++;
+
+	fputc(b, output);
+	if (params.checksum)
+		checksum_update(&b, 1);
+
+	return true;
+}
+
+/*
+ * Process the files given after the options (cf. parse_options()) or stdin.
+ *
+ * return false if a file could not be processed.
+ */
+bool
+run(int argc, char * const *argv)
+{
+	bool success = true;
+
+	/* may be left over from an earlier request, cf. server.c */
+	memset(&checkpoint, 0, sizeof(checkpoint));
+	if (params.resume)
+		checkpoint_load();
+
+	init();
+
+	if (opt_ind < argc) {
+		/* process all files */
+		do {
+			if (!process(argv[opt_ind++], params.outfile))
+				success = false;
+		} while (opt_ind < argc);
+	} else {
+		/* read stdin */
+		success = process(NULL, params.outfile);
+	}
+
+	if (params.checkpoint)
+		checkpoint_finish();
+
+	return success;
 }
 
 bool
@@ -412,20 +989,79 @@ usage(void)
 			" process it like a normal filename.\n"
 			"\noptions:\n"
 			"  -a\t\tshow ascii representation of bytes in an additional column\n"
-			"  -b SIZE\tread/write using bufsize of SIZE bytes if "
-			"read/write from/to a file\n"
+			"  -A\t\tcalibrate: find the fastest kernels, bufsize and number"
+			"\n\t\t\tof threads of this host and save them to its profile\n"
+			"  -b SIZE\tread/write using bufsize of SIZE bytes\n"
+			"\t\t\t(default: the one of the profile, if any, otherwise the\n"
+			"\t\t\tpreferred I/O size of the input file, 1 MiB"
+			" for pipes)\n"
+			"  -c NAMES\tcompute checksums of the processed (or, with \"-r\","
+			" the\n\t\t\treconstructed) bytes and print them after the last"
+			" offset\n\t\t\t(to stderr with \"-p\" or \"-r\", after the"
+			" summary with \"-e\")\n"
+			"\t\t\tNAMES is a comma-separated list of:\n"
+			"\t\t\t\tcrc32c, sha256, xxh64, all\n"
+			"  -C DIR\tcache the formatted blocks of the input in DIR and"
+			" reuse them\n\t\t\tfor unchanged blocks in later runs\n"
 			"  -d FILE\twrite (append) to file FILE instead of stdout\n"
+			"  -D\t\tdirect I/O: do not flood the page cache when reading/"
+			"writing\n\t\t\tfiles (implies a bufsize of at least 1 MiB)\n"
+			"  -e BLOCK\tanalysis mode: print entropy, percentage of zero and"
+			" printable\n\t\t\tbytes and number of distinct byte values"
+			" of every BLOCK\n\t\t\tbytes and a summary with a histogram"
+			" of the byte values\n\t\t\t(histogram for every block with"
+			" \"-f\")\n"
 			"  -f\t\tfull output - do not replace consecutive "
 			"identical lines with an asterisk\n"
+			"  -g SECONDS\treport the progress to stderr every SECONDS"
+			" (and on SIGUSR1)\n"
 			"  -h\t\tshow this help\n"
+			"  -i STRIDE\tindex the first line of every STRIDE input bytes"
+			" (default:\n\t\t\t1 MiB, cf. \"-I\")\n"
+			"  -I FILE\twrite an index of the positions of the lines in the"
+			" output\n\t\t\tto FILE; with \"-r\", seek to \"-s\" with it"
+			" instead of\n\t\t\tdecoding everything before\n"
+			"  -j NUM\tuse NUM threads: with \"-d\" and \"-f\", regular files"
+			" are\n\t\t\tformatted and written in parallel, with \"-r\""
+			" they are\n\t\t\tdecoded in parallel\n"
+			"  -k FILE\tsave the state to FILE regularly (requires \"-d\"),"
+			" so that an\n\t\t\tinterrupted run can be continued with"
+			" \"-K\"\n"
+			"  -K\t\tresume from the checkpoint saved with \"-k\" (same"
+			" options and\n\t\t\tfiles as the interrupted run)\n"
 			"  -l NUM\tprocess only NUM bytes\n"
-			"  -L\t\tshow the limits of the numeric arguments\n"
+			"  -L\t\tshow the limits of the numeric arguments\n",
+		NAME_STR
+			);
+	/* in two parts, a string literal should not exceed 4095 characters */
+	fputs("  -m SIZE\treplace lines repeating one of the last SIZE bytes"
+			" by\n\t\t\tback-references \"@POS+LEN\" (use with \"-f\"),"
+			" expand them\n\t\t\tin reverse mode (needs the same SIZE)\n"
+			"  -M PID[:RANGES]\tdump the memory of the running process PID"
+			" (all readable\n\t\t\tmappings or the comma-separated"
+			" ranges START-END, hex)\n\t\t\twith the addresses as"
+			" offsets\n"
 			"  -n\t\tno offset at the beginning of every line of output\n"
+			"  -o\t\tshort offsets: only as many digits as the size of a"
+			" regular\n\t\t\tinput file needs\n"
+			"  -p\t\tplain mode: continuous stream of numeric values without"
+			" offset,\n\t\t\tspaces or asterisks, wrapped after WIDTH bytes"
+			" if \"-w\" is\n\t\t\tgiven (no limit, 0 = never)\n"
+			"  -P FILE\tpatch mode: write the bytes of the dump lines read"
+			" (with\n\t\t\toffsets) to FILE at their offsets\n"
 			"  -r\t\treverse mode: translate string representations of numeric"
 			" values to bytes\n"
 			"\t\t\tTabs, spaces and newlines are silently skipped.\n"
+			"\t\t\tWith \"-t x\" or \"-t X\", dumps of xxd, hexdump -C"
+			" and\n\t\t\tod -tx1 are recognised and restored.\n"
 			"\t\t\trequires \"-t\" option\n"
 			"  -s NUM\tskip first NUM bytes of every input file (or stdin)\n"
+			"  -S SPEC\tsampling mode: dump only some lines of a seekable"
+			" file, SPEC:\n"
+			"\t\t\t\tstep:N (every Nth line)\n"
+			"\t\t\t\trandom:K[:SEED] (K random lines)\n"
+			"\t\t\t\tprobe:N (first, last and N evenly spaced"
+			" lines)\n"
 			"  -t TYPE\tset numeric system to TYPE\n"
 			"\t\t\tavailable types are:\n"
 			"\t\t\t\tX (hexadecimal uppercase) (default)\n"
@@ -434,12 +1070,25 @@ usage(void)
 			"\t\t\t\td (decimal)\n"
 			"\t\t\t\to (octal)\n"
 			"\t\t\t\tx (hexadecimal lowercase)\n"
+			"  -T TYPE:FILE\tdump as TYPE to FILE, too, in the same pass"
+			" over the input\n\t\t\t(up to 8 times, in parallel"
+			" with \"-j\")\n"
+			"  -u PATH\tclient mode: let the server listening on PATH process"
+			" the\n\t\t\tother arguments (with the stdin/stdout/stderr"
+			" of the client)\n"
+			"  -U PATH\tserver mode: serve requests on the UNIX socket PATH"
+			" with\n\t\t\t\"-j\" worker processes\n"
 			"  -v\t\tshow version information\n"
-			"  -w WIDTH\tdisplay WIDTH bytes per line (arbitrary limit: 256)\n"
+			"  -w WIDTH\tdisplay WIDTH bytes per line (arbitrary limit: 256,"
+			" except for \"-p\")\n"
+			"  -z LEVEL\tgzip the output with compression LEVEL (1-9) in a"
+			" separate\n\t\t\tthread\n"
 			"\nnotes:\n"
-			"Use -L to see the limits of the numeric arguments on your system.\n",
-		NAME_STR
-			);
+			"Use -L to see the limits of the numeric arguments on your system.\n"
+			"gzip-compressed input is decompressed in a separate thread.\n"
+			"The profile written by -A is $NDC_PROFILE (none if empty) or\n"
+			"${XDG_CACHE_HOME:-$HOME/.cache}/ndc/profile-HOSTNAME.\n",
+		stdout);
 }
 
 void
@@ -459,78 +1108,29 @@ version(void)
 int
 main(int argc, char * const *argv)
 {
-	const char *outfile = NULL;
-	int opt;
+	int status;
+	bool success;
 
-	while ((opt = getopt_portable(argc, argv, "ab:d:fhl:Lnrs:t:vw:")) != -1) {
-		switch (opt) {
-		case 'a':
-			params.ascii_col = true;
-			break;
-		case 'b':
-			if (sscanf(opt_arg, "%zu", &params.bufsize) <= 0
-					|| !params.bufsize)
-				die("option '%c' -- invalid size: %s", opt, opt_arg);
-			break;
-		case 'd':
-			outfile = opt_arg;
-			break;
-		case 'f':
-			params.full = true;
-			break;
-		case 'h':
-			usage();
-			return EXIT_SUCCESS;
-		case 'l':
-			if (strchr(opt_arg, '-')
-					|| sscanf(opt_arg, "%"SCNuFAST64, &params.limit) <= 0)
-				die("option '%c' -- invalid size: %s", opt, opt_arg);
-			params.limited = true;
-			break;
-		case 'L':
-			limits();
-			return EXIT_SUCCESS;
-		case 'n':
-			params.offset = false;
-			break;
-		case 'r':
-			params.reverse = true;
-			break;
-		case 's':
-			if (strchr(opt_arg, '-')
-					|| sscanf(opt_arg, "%"SCNuFAST64, &params.skip) <= 0)
-				die("option '%c' -- invalid size: %s", opt, opt_arg);
-			break;
-		case 't':
-			if (!set_type(opt_arg))
-				die("option '%c' -- unsupported type: %s", opt, opt_arg);
-			break;
-		case 'v':
-			version();
-			return EXIT_SUCCESS;
-		case 'w':
-			if (strchr(opt_arg, '-')
-					|| sscanf(opt_arg, "%u", &params.width) <= 0
-					|| !params.width || params.width > 256)
-				die("option '%c' -- invalid size: %s", opt, opt_arg);
-			break;
-		default:
-			usage();
-			return EXIT_FAILURE;
-		}
-	}
+	if ((status = parse_options(argc, argv)) != -1)
+		return status;
 
-	init();
+	if (params.server)
+		server(params.server); /* does not return */
+	else if (params.client)
+		return client(params.client, argc, argv);
 
-	if (opt_ind < argc) {
-		/* process all files */
-		do {
-			process(argv[opt_ind++], outfile);
-		} while (opt_ind < argc);
-	} else {
-		/* read stdin */
-		process(NULL, outfile);
+	/* after all options, which apply to the benchmarks */
+	if (params.calibrate) {
+		tune_calibrate();
+		return EXIT_SUCCESS;
 	}
 
-	return EXIT_SUCCESS;
+	io_setup_std();
+	success = run(argc, argv);
+	if (!io_close_std())
+		success = false;
+	multi_clean();
+	arena_clean();
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
 }
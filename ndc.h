@@ -30,32 +30,111 @@
 #define OFFSET_CHAR_LEN        ((sizeof(uint_fast64_t)*CHAR_BIT+3)/4+2)
 /* length of offset representation in bits */
 #define UINT_FAST64_T_BIT_LEN  (sizeof(uint_fast64_t)*CHAR_BIT)
+/* maximum number of additional representations ("-T") */
+#define MULTI_MAX              8
 
 
 /*
+ * analysis               block size for analysis mode (histogram, entropy)
+ *                          instead of dumping, 0 = off
  * ascii_col              print ascii representation as little column after
  *                          numeric representation?
- * bufsize                size of the chunks we read
+ * base                   added to every offset (address of the memory dumped,
+ *                          cf. memory.c)
+ * bufsize                size of the chunks we read, 0 = auto (cf. io_bufsize())
+ * calibrate              run the benchmarks of the host profile instead of
+ *                          processing files (cf. tune.c)
+ * cache                  directory of the formatted blocks of earlier runs
+ *                          (cf. cache.c), NULL = off
+ * checkpoint             file to save the state to regularly (cf. checkpoint.c),
+ *                          NULL = off
+ * checksum               checksums/digests to compute over the processed bytes
+ *                          (cf. enum Checksum), 0 = none
+ * client                 send the request to the server listening on this
+ *                          UNIX socket (cf. server.c), NULL = off
+ * compress               gzip level to compress the output with (cf.
+ *                          compress.c), 0 = off
+ * dictionary             replace lines repeating one of the last n bytes by
+ *                          back-references (cf. dictionary.c), 0 = off
+ * direct                 avoid flooding the page cache (O_DIRECT or dropping
+ *                          processed pages), cf. io.c
+ * fit_offset             only as many offset digits as the size of a regular
+ *                          input file needs (cf. offset_length())
  * full                   full output - do not replace consecutive identical
  *                          lines with an asterisk (defaults to false)
+ * index                  write the index of the dump to this file or, in
+ *                          reverse mode, seek with it (cf. index.c), NULL = off
+ * index_stride           number of input bytes between two entries of the
+ *                          index, 0 = default
+ * jobs                   number of threads to use where possible (default=1)
  * limit                  stop after n bytes (applies only if "limited" is set)
  * limited                respect "limit"
+ * memory                 dump the memory of the process "PID[:RANGES]" instead
+ *                          of files (cf. memory.c), NULL = off
+ * multi                  number of additional representations in "multi_spec"
+ *                          dumped in the same pass (cf. multi.c)
+ * multi_spec             "TYPE:FILE" of every additional representation
  * offset                 wether to display the offset at the beginning of every
  *                          line of output (default=true)
+ * outfile                write (append) to this file instead of stdout, NULL =
+ *                          stdout
+ * parallel_jobs          number of threads of the parallel dump and reverse
+ *                          mode (cf. parallel.c): "jobs" or, without "-j",
+ *                          the one of the host profile (cf. tune.c)
+ * patch                  write the bytes of the dump lines read to their
+ *                          offsets in this file (cf. patch.c), NULL = off
+ * plain                  continuous stream of digits without offset, spaces
+ *                          and masking, wrapped after "width" bytes (0 = never)
+ * progress               report the progress every n seconds (cf.
+ *                          progress.c), 0 = only on SIGUSR1
+ * resume                 continue from the state saved in "checkpoint"
  * reverse                translate numeric system -> bytes (defaults to false)
+ * sample                 dump only a sample of the lines (cf. enum Sample and
+ *                          sample.c), 0 = off
+ * sample_count           N or K of the sample specification
+ * sample_seed            seed of random samples
+ * server                 serve requests on this UNIX socket (cf. server.c),
+ *                          NULL = off
  * skip                   skip n bytes
  * type                   numeric system to use to encode input or decode input
  *                          defaults to hex (uppercase) - cf. init()
  * width                  number of bytes to display per line
  */
 typedef struct {
+	uint_fast64_t      analysis;
 	bool               ascii_col;
+	uint_fast64_t      base;
 	size_t             bufsize;
+	bool               calibrate;
+	const char        *cache;
+	const char        *checkpoint;
+	unsigned           checksum;
+	const char        *client;
+	int                compress;
+	uint_fast64_t      dictionary;
+	bool               direct;
+	bool               fit_offset;
 	bool               full;
+	const char        *index;
+	uint_fast64_t      index_stride;
+	unsigned           jobs;
 	uint_fast64_t      limit;
 	bool               limited;
+	const char        *memory;
+	unsigned           multi;
+	const char        *multi_spec[MULTI_MAX];
 	bool               offset;
+	const char        *outfile;
+	unsigned           parallel_jobs;
+	const char        *patch;
+	bool               plain;
+	unsigned           progress;
+	bool               resume;
 	bool               reverse;
+	unsigned           sample;
+	uint_fast64_t      sample_count;
+	uint_fast64_t      sample_seed;
+	const char        *server;
 	uint_fast64_t      skip;
 	unsigned           width;
 } Params;
@@ -63,12 +142,21 @@ typedef struct {
 
 /* functions */
 char *append_ascii_col(char *out, const unsigned char *in, unsigned n);
+void  count_offset(char *out, uint_fast64_t n);
+bool  dump(FILE *input, FILE *output);
 void  get_offset(char *out, uint_fast64_t byte_count);
+void  init_type(void);
+int   parse_options(int argc, char * const *argv);
+bool  run(int argc, char * const *argv);
+bool  set_type(const char *name);
+int   skip_offset(FILE *f);
 
 /* function pointer */
 extern char * (*byte_to_numeric)(char *out, const unsigned char *in, unsigned n);
 
 /* variables */
+extern size_t bufsize;
+extern unsigned offset_len;
 extern Params params;
 extern Repository type;
 
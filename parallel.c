@@ -0,0 +1,673 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Parallel dump (option "-j") of a regular file to a regular file ("-d") with
+ * full output ("-f"): Without masking, every line has the same length, so the
+ * position of every line in the output is known in advance. The output file
+ * is preallocated and the worker threads read, format and write disjoint
+ * chunks of lines using pread()/pwrite() - there is no ordered writer. The
+ * main thread only waits for them and reports the progress ("-g") of the
+ * completed chunks.
+ *
+ * Parallel reverse mode (option "-j" with "-r") of a regular file: The
+ * input is split into chunks at separators (cf. skip_characters), so that
+ * every chunk starts with a new token and can be decoded on its own. Every
+ * worker thread decodes every "params.parallel_jobs"th chunk, the main thread
+ * writes the decoded chunks in order (respecting "-s" and "-l", which count
+ * decoded bytes) and reports the progress after them. Back-references ("-m")
+ * are decoded serially, as they refer to bytes of earlier chunks.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "checksum.h"
+#include "compress.h"
+#include "config.h"
+#include "index.h"
+#include "parallel.h"
+#include "progress.h"
+#include "repository.h"
+#include "util.h"
+/* last */
+#include "ndc.h"
+
+
+/* minimum number of input bytes per chunk */
+#define CHUNK_MIN  (1 << 20)
+
+/* classes of input characters of the reverse mode, cf. Reverse */
+#define SEPARATOR  -1
+#define INVALID    -2
+
+
+/*
+ * in, out        file descriptors
+ * out_start      output position of the first line
+ * bytes          number of input bytes to dump
+ * lines          number of lines (including the last incomplete one)
+ * chunk_lines    number of lines per chunk
+ * line_len       length of one (complete) output line
+ * done           number of input bytes of the completed chunks
+ * finished       number of workers that are done
+ * lock           protects "done" and "finished"
+ * cond           signals changes of "done" and "finished"
+ */
+typedef struct {
+	int in;
+	int out;
+	off_t out_start;
+	uint_fast64_t bytes;
+	uint_fast64_t lines;
+	uint_fast64_t chunk_lines;
+	size_t line_len;
+	uint_fast64_t done;
+	unsigned finished;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} Job;
+
+/*
+ * thread   the thread itself
+ * id       index of the first chunk, every "params.parallel_jobs"th chunk
+ *            follows
+ * success  whether all chunks have been processed successfully
+ */
+typedef struct {
+	pthread_t thread;
+	uint_fast64_t id;
+	bool success;
+} Worker;
+
+/*
+ * thread    the thread itself
+ * id        index of the first chunk, every "params.parallel_jobs"th chunk
+ *             follows
+ * in        input chunk
+ * out       decoded bytes of the chunk
+ * size      size of "in" and "out"
+ * n         number of bytes in "out"
+ * end       input position after the chunk (relative to "rev.start")
+ * invalid   first invalid character of the chunk (decoded up to it), 0 = none
+ * ready     whether "out" is to be written by the main thread
+ * last      whether there are no more chunks
+ * success   whether the chunk could be read
+ */
+typedef struct {
+	pthread_t thread;
+	uint_fast64_t id;
+	unsigned char *in;
+	unsigned char *out;
+	size_t size;
+	size_t n;
+	uint_fast64_t end;
+	char invalid;
+	bool ready;
+	bool last;
+	bool success;
+} Decoder;
+
+/*
+ * fd        input file descriptor
+ * start     input position of the first character
+ * size      number of input characters
+ * chunk     nominal number of input characters per chunk
+ * class     digit value of every character or SEPARATOR or INVALID (like
+ *             dump_reverse())
+ * stop      whether the workers have to stop
+ * lock      protects "ready" of every Decoder and "stop"
+ * cond      signals changes of "ready" and "stop"
+ */
+typedef struct {
+	int fd;
+	off_t start;
+	uint_fast64_t size;
+	uint_fast64_t chunk;
+	int class[UCHAR_MAX+1];
+	bool stop;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} Reverse;
+
+
+static uint_fast64_t  boundary(uint_fast64_t pos);
+static size_t         decode(Decoder *d, size_t n);
+static void          *decode_work(void *arg);
+static char          *format_line(char *out, const unsigned char *in, unsigned n,
+		uint_fast64_t offset);
+static bool           pread_full(int fd, void *buf, size_t n, off_t pos);
+static bool           pwrite_full(int fd, const void *buf, size_t n,
+		off_t pos);
+static void          *work(void *arg);
+
+
+/* private variables */
+static Job job = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+static Reverse rev = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+
+/*
+ * Return the start of the first token at or after "pos" (relative to
+ * "rev.start"), i.e. the position after the next separator. Chunks
+ * [boundary(i*chunk), boundary((i+1)*chunk)) do not split tokens.
+ */
+uint_fast64_t
+boundary(uint_fast64_t pos)
+{
+	unsigned char buf[4096];
+	size_t n, i;
+
+	if (!pos || pos >= rev.size)
+		return pos < rev.size ? pos : rev.size;
+
+	for (pos--; pos < rev.size; pos += n) {
+		n = rev.size-pos < sizeof(buf) ? rev.size-pos : sizeof(buf);
+		if (!pread_full(rev.fd, buf, n, rev.start+pos))
+			die("pread: %s", strerror(errno));
+		for (i = 0; i < n; i++) {
+			if (rev.class[buf[i]] == SEPARATOR)
+				return pos+i+1;
+		}
+	}
+
+	return rev.size;
+}
+
+/*
+ * Decode the "n" characters of "d->in" to "d->out" like dump_reverse().
+ *
+ * return number of bytes decoded.
+ */
+size_t
+decode(Decoder *d, size_t n)
+{
+	unsigned char *o = d->out;
+	unsigned value = 0, count = 0;
+	size_t i;
+	int c;
+
+	d->invalid = 0;
+	for (i = 0; i < n; i++) {
+		c = rev.class[d->in[i]];
+		if (c >= 0) {
+			value = value*type.base+c;
+			if (++count < type.char_width)
+				continue;
+		} else if (c == INVALID) {
+			d->invalid = d->in[i];
+			return o-d->out;
+		} else if (!count) {
+			continue;
+		}
+		*o++ = value;
+		value = 0;
+		count = 0;
+	}
+	/* the last token of the input may be incomplete */
+	if (count)
+		*o++ = value;
+
+	return o-d->out;
+}
+
+/* thread function: decode every "params.parallel_jobs"th chunk */
+void *
+decode_work(void *arg)
+{
+	Decoder *d = arg;
+	uint_fast64_t c, start, end;
+	size_t n;
+
+	for (c = d->id; ; c += params.parallel_jobs) {
+		start = c < rev.size/rev.chunk+1 ? boundary(c*rev.chunk)
+			: rev.size;
+		d->success = true;
+		d->last = start == rev.size;
+		d->n = 0;
+		d->end = start;
+		if (!d->last) {
+			d->end = end = boundary((c+1)*rev.chunk);
+			n = end-start;
+			if (n > d->size) {
+				free(d->in);
+				free(d->out);
+				d->size = n;
+				d->in = _malloc(n);
+				d->out = _malloc(n);
+			}
+			if (pread_full(rev.fd, d->in, n, rev.start+start))
+				d->n = decode(d, n);
+			else
+				d->success = false;
+		}
+
+		pthread_mutex_lock(&rev.lock);
+		d->ready = true;
+		pthread_cond_broadcast(&rev.cond);
+		while (d->ready && !rev.stop)
+			pthread_cond_wait(&rev.cond, &rev.lock);
+		pthread_mutex_unlock(&rev.lock);
+
+		if (rev.stop || d->last || !d->success)
+			break;
+	}
+
+	return NULL;
+}
+
+/*
+ * Dump "infile" to "outfile" (appending) using "params.parallel_jobs" threads.
+ * Produces exactly the same output as dump().
+ */
+bool
+dump_parallel(const char *infile, const char *outfile)
+{
+	char *header, last[OFFSET_CHAR_LEN+1];
+	Worker *workers;
+	struct stat st;
+	FILE *input;
+	off_t end;
+	uint_fast64_t done;
+	size_t header_len;
+	unsigned i, started;
+	bool success = true;
+
+	/* a stream only for progress_begin() */
+	if (!(input = fopen(infile, "rb"))) {
+		err("Failed to open \"%s\".", infile);
+		return false;
+	}
+	job.in = fileno(input);
+	if ((job.out = open(outfile, O_WRONLY | O_CREAT, 0666)) < 0)
+		die("Failed to open/create output file.");
+	if (fstat(job.in, &st))
+		die("fstat: %s", strerror(errno));
+
+	job.bytes = st.st_size-params.skip;
+	if (params.limited && params.limit < job.bytes)
+		job.bytes = params.limit;
+	job.lines = (job.bytes+params.width-1)/params.width;
+	job.chunk_lines = (CHUNK_MIN > bufsize ? CHUNK_MIN : bufsize)/params.width;
+	job.line_len = (params.offset ? offset_len : 0)
+		+ params.width*(type.char_width+type.space)-type.space
+		+ (params.ascii_col ? params.width+5 : 1);
+
+	header = _malloc(strlen(infile)+sizeof("Processing  ...\n"));
+	header_len = sprintf(header, "Processing %s ...\n", infile);
+
+	/* append, i.e. start at the current end of the output file */
+	if ((end = lseek(job.out, 0, SEEK_END)) < 0)
+		die("lseek: %s", strerror(errno));
+	job.out_start = end+header_len;
+	end = job.out_start + job.lines*job.line_len
+		+ (params.offset ? offset_len+1 : 0);
+	/* the last line may be shorter */
+	if (job.bytes % params.width && !params.ascii_col)
+		end -= (params.width-job.bytes%params.width)*(type.char_width+type.space);
+	else if (job.bytes % params.width)
+		end -= params.width-job.bytes%params.width;
+
+	if ((errno = posix_fallocate(job.out, job.out_start-header_len,
+					end-job.out_start+header_len)))
+		die("posix_fallocate: %s", strerror(errno));
+	if (!pwrite_full(job.out, header, header_len, job.out_start-header_len))
+		die("pwrite: %s", strerror(errno));
+	free(header);
+
+	job.done = 0;
+	job.finished = 0;
+	progress_begin(infile, input);
+
+	workers = _calloc(params.parallel_jobs, sizeof(*workers));
+	for (started = 0; started < params.parallel_jobs; started++) {
+		workers[started].id = started;
+		if (pthread_create(&workers[started].thread, NULL, work,
+					&workers[started]))
+			break;
+	}
+	if (!started)
+		die("pthread_create: failed to create any thread");
+	/* woken after every chunk, so reports cost nothing per line */
+	pthread_mutex_lock(&job.lock);
+	while (job.finished < started) {
+		pthread_cond_wait(&job.cond, &job.lock);
+		if (progress_due) {
+			done = job.done;
+			pthread_mutex_unlock(&job.lock);
+			progress_report(done);
+			pthread_mutex_lock(&job.lock);
+		}
+	}
+	pthread_mutex_unlock(&job.lock);
+	for (i = 0; i < started; i++) {
+		pthread_join(workers[i].thread, NULL);
+		success = success && workers[i].success;
+	}
+	/* chunks of threads that could not be created */
+	for (; i < params.parallel_jobs; i++) {
+		work(&workers[i]);
+		success = success && workers[i].success;
+	}
+	free(workers);
+	progress_end(job.done);
+
+	/* do not forget the last offset */
+	if (params.offset) {
+		get_offset(last, params.skip+job.bytes);
+		last[offset_len] = '\n';
+		if (!pwrite_full(job.out, last, offset_len+1, end-offset_len-1))
+			die("pwrite: %s", strerror(errno));
+	}
+
+	fclose(input);
+	if (close(job.out))
+		die("close: %s", strerror(errno));
+
+	return success;
+}
+
+/*
+ * Reverse the regular file "input" to "output" using "params.parallel_jobs"
+ * threads.
+ * Produces exactly the same output as dump_reverse().
+ */
+bool
+dump_reverse_parallel(FILE *input, FILE *output)
+{
+	Decoder *decoders, *d;
+	struct stat st;
+	uint_fast64_t c, skip = params.skip, byte_count = 0, done = 0;
+	size_t n, from;
+	unsigned i, started;
+	const char *ptr;
+	bool success = true, more = true;
+
+	if (params.index)
+		skip = index_seek(input, skip);
+	rev.fd = fileno(input);
+	if (fstat(rev.fd, &st) || (rev.start = ftello(input)) < 0)
+		die("fstat: %s", strerror(errno));
+	rev.size = st.st_size > rev.start ? st.st_size-rev.start : 0;
+	rev.chunk = CHUNK_MIN > bufsize ? CHUNK_MIN : bufsize;
+	rev.stop = false;
+	for (i = 0; i <= UCHAR_MAX; i++) {
+		if ((ptr = strchr(type.characters, i)))
+			rev.class[i] = ptr-type.characters;
+		else if (strchr(skip_characters, i))
+			rev.class[i] = SEPARATOR;
+		else
+			rev.class[i] = INVALID;
+	}
+
+	decoders = _calloc(params.parallel_jobs, sizeof(*decoders));
+	for (started = 0; started < params.parallel_jobs; started++) {
+		decoders[started].id = started;
+		if (pthread_create(&decoders[started].thread, NULL, decode_work,
+					&decoders[started]))
+			break;
+	}
+	if (started < params.parallel_jobs)
+		die("pthread_create: failed to create the threads");
+
+	/* write the chunks in order */
+	for (c = 0; more; c++) {
+		d = &decoders[c%params.parallel_jobs];
+		pthread_mutex_lock(&rev.lock);
+		while (!d->ready)
+			pthread_cond_wait(&rev.cond, &rev.lock);
+		pthread_mutex_unlock(&rev.lock);
+
+		done = d->end;
+		if (d->last)
+			break;
+		if (!d->success) {
+			success = false;
+			break;
+		}
+
+		from = skip < d->n ? skip : d->n;
+		skip -= from;
+		n = d->n-from;
+		/* like put_byte(), stop at the first byte after the limit */
+		if (params.limited && params.limit-byte_count < n) {
+			n = params.limit-byte_count;
+			more = false;
+		}
+		fwrite(d->out+from, 1, n, output);
+		if (params.checksum)
+			checksum_update(d->out+from, n);
+		byte_count += n;
+
+		if (d->invalid && more)
+			die("error: invalid character -- \"%c\".", d->invalid);
+		/* once per chunk, cf. progress.c */
+		if (progress_due)
+			progress_report(rev.start+done);
+
+		pthread_mutex_lock(&rev.lock);
+		d->ready = false;
+		pthread_cond_broadcast(&rev.cond);
+		pthread_mutex_unlock(&rev.lock);
+	}
+
+	pthread_mutex_lock(&rev.lock);
+	rev.stop = true;
+	pthread_cond_broadcast(&rev.cond);
+	pthread_mutex_unlock(&rev.lock);
+	for (i = 0; i < params.parallel_jobs; i++) {
+		pthread_join(decoders[i].thread, NULL);
+		/* clear used memory */
+		if (decoders[i].size) {
+			memset(decoders[i].in, 0, decoders[i].size);
+			memset(decoders[i].out, 0, decoders[i].size);
+		}
+		free(decoders[i].in);
+		free(decoders[i].out);
+	}
+	free(decoders);
+	progress_end(rev.start+done);
+
+	return success;
+}
+
+/*
+ * Like DumpState, but without state, so that it can be used by every thread.
+ *
+ * return pointer to index after last character written.
+ */
+char *
+format_line(char *out, const unsigned char *in, unsigned n, uint_fast64_t offset)
+{
+	char *after_dump, *eol;
+
+	if (params.offset) {
+		get_offset(out, offset);
+		out += offset_len;
+	}
+	eol = byte_to_numeric(out, in, n);
+	if (!params.ascii_col) {
+		*eol++ = '\n';
+		return eol;
+	}
+
+	after_dump = out + params.width*(type.char_width+type.space)-type.space;
+	while (eol < after_dump)
+		*eol++ = ' ';
+
+	return append_ascii_col(after_dump, in, n);
+}
+
+/*
+ * Is the parallel dump possible, i.e. do we get a regular input file of known
+ * size and a regular output file, and is every line of the same length?
+ */
+bool
+parallel_applicable(const char *infile, const char *outfile)
+{
+	struct stat st;
+
+	if (params.parallel_jobs < 2 || !infile || !outfile || !params.full
+			|| params.reverse || params.plain || params.analysis
+			|| params.cache || params.checkpoint || params.checksum
+			|| params.compress || params.dictionary || params.direct
+			|| params.index || params.multi || params.patch
+			|| params.sample)
+		return false;
+	if (stat(infile, &st) || !S_ISREG(st.st_mode)
+			|| (uint_fast64_t)st.st_size <= params.skip
+			|| compressed(infile))
+		return false;
+	if (!stat(outfile, &st) && !S_ISREG(st.st_mode))
+		return false;
+
+	return true;
+}
+
+bool
+pread_full(int fd, void *buf, size_t n, off_t pos)
+{
+	ssize_t r;
+
+	while (n) {
+		if ((r = pread(fd, buf, n, pos)) <= 0) {
+			if (r < 0 && errno == EINTR)
+				continue;
+			return false;
+		}
+		buf = (char *)buf+r;
+		n -= r;
+		pos += r;
+	}
+
+	return true;
+}
+
+bool
+pwrite_full(int fd, const void *buf, size_t n, off_t pos)
+{
+	ssize_t r;
+
+	while (n) {
+		if ((r = pwrite(fd, buf, n, pos)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		buf = (const char *)buf+r;
+		n -= r;
+		pos += r;
+	}
+
+	return true;
+}
+
+/*
+ * Is the parallel reverse mode possible, i.e. is "input" a regular file (not
+ * read with "-D") and are there no back-references?
+ */
+bool
+reverse_parallel_applicable(FILE *input)
+{
+	struct stat st;
+	int fd;
+
+	if (params.parallel_jobs < 2 || params.plain || params.checkpoint
+			|| params.dictionary || params.direct)
+		return false;
+	if ((fd = fileno(input)) < 0 || fstat(fd, &st) || !S_ISREG(st.st_mode))
+		return false;
+
+	return true;
+}
+
+/* thread function: process every "params.parallel_jobs"th chunk */
+void *
+work(void *arg)
+{
+	Worker *w = arg;
+	unsigned char *in;
+	char *out, *o;
+	uint_fast64_t c, first, i, lines, n;
+	unsigned len;
+
+	in = _malloc(job.chunk_lines*params.width);
+	out = _malloc(job.chunk_lines*job.line_len);
+	w->success = true;
+
+	for (c = w->id; c*job.chunk_lines < job.lines; c += params.parallel_jobs) {
+		first = c*job.chunk_lines;
+		lines = job.lines-first < job.chunk_lines ?
+			job.lines-first : job.chunk_lines;
+		n = job.bytes-first*params.width < lines*params.width ?
+			job.bytes-first*params.width : lines*params.width;
+
+		if (!pread_full(job.in, in, n, params.skip+first*params.width)) {
+			w->success = false;
+			break;
+		}
+		for (o = out, i = 0; i < n; i += len) {
+			len = n-i < params.width ? n-i : params.width;
+			o = format_line(o, in+i, len,
+					params.skip+first*params.width+i);
+		}
+		if (!pwrite_full(job.out, out, o-out,
+					job.out_start+first*job.line_len)) {
+			w->success = false;
+			break;
+		}
+
+		pthread_mutex_lock(&job.lock);
+		job.done += n;
+		pthread_cond_signal(&job.cond);
+		pthread_mutex_unlock(&job.lock);
+	}
+	pthread_mutex_lock(&job.lock);
+	job.finished++;
+	pthread_cond_signal(&job.cond);
+	pthread_mutex_unlock(&job.lock);
+
+	/* clear used memory */
+	memset(in, 0, job.chunk_lines*params.width);
+	memset(out, 0, job.chunk_lines*job.line_len);
+	free(in);
+	free(out);
+
+	return NULL;
+}
@@ -0,0 +1,31 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+
+bool  dump_parallel(const char *infile, const char *outfile);
+bool  dump_reverse_parallel(FILE *input, FILE *output);
+bool  parallel_applicable(const char *infile, const char *outfile);
+bool  reverse_parallel_applicable(FILE *input);
+
+
+#endif /* PARALLEL_H */
@@ -0,0 +1,200 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Patch mode (option "-P FILE"): read lines of a dump with offsets (e.g. an
+ * edited excerpt of an earlier dump of FILE) and write their bytes to FILE at
+ * their offsets. Nothing else of FILE is read or written, so changing a few
+ * bytes of a huge image does not need a dump and reverse of all of it.
+ *
+ * A line is "OFFSET  VALUE VALUE ..." optionally followed by the ASCII column
+ * ("|...|"), the values being of type "-t". Lines which do not start with an
+ * offset followed by a space ("Processing ...", "*", "--", ...), lines
+ * without values (the last offset) and back-references ("@POS+LEN" of "-m",
+ * whose bytes are not in the excerpt) are ignored. Contiguous lines are
+ * written together.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "patch.h"
+#include "progress.h"
+#include "repository.h"
+#include "util.h"
+/* last */
+#include "ndc.h"
+
+
+static bool    flush(int fd, const unsigned char *buf, size_t n,
+		uint_fast64_t pos);
+static size_t  parse_line(const char *line, unsigned char *out,
+		unsigned long number);
+
+
+/*
+ * return false on errors.
+ */
+bool
+dump_patch(FILE *input)
+{
+	unsigned char *buf;
+	char *line = NULL, *end;
+	uint_fast64_t start = 0, offset, processed = 0;
+	size_t cap = 0, n = 0, size, len;
+	unsigned long number = 0;
+	ssize_t line_len;
+	int fd;
+	bool success = true;
+
+	if ((fd = open(params.patch, O_WRONLY)) < 0) {
+		err("Failed to open \"%s\": %s", params.patch, strerror(errno));
+		return false;
+	}
+
+	size = bufsize;
+	buf = arena_block(ARENA_OUT, size);
+
+	while ((line_len = getline(&line, &cap, input)) > 0) {
+		number++;
+		processed += line_len;
+		if (progress_due)
+			progress_report(processed);
+
+		errno = 0;
+		offset = strtoull(line, &end, 16);
+		if (!isxdigit((unsigned char)*line) || errno || *end != ' '
+				|| end[strspn(end, " ")] == '@')
+			continue;
+
+		/* a line cannot have more values than characters */
+		if (n+cap > size) {
+			if (!(success = flush(fd, buf, n, start)))
+				break;
+			n = 0;
+			if (cap > size) {
+				size = cap;
+				buf = arena_block(ARENA_OUT, size);
+			}
+		}
+
+		if (!(len = parse_line(end, buf+n, number)))
+			continue;
+		if (n && offset != start+n) {
+			/* not contiguous */
+			if (!(success = flush(fd, buf, n, start)))
+				break;
+			memmove(buf, buf+n, len);
+			n = 0;
+		}
+		if (!n)
+			start = offset;
+		n += len;
+	}
+	if (success)
+		success = flush(fd, buf, n, start) && !ferror(input);
+	progress_end(processed);
+
+	/* clear used memory */
+	memset(buf, 0, size);
+	/* the block is kept for the next file, cf. arena.c */
+	if (line)
+		memset(line, 0, cap);
+	free(line);
+
+	if (close(fd)) {
+		err("Failed to close \"%s\": %s", params.patch, strerror(errno));
+		success = false;
+	}
+
+	return success;
+}
+
+/*
+ * Write the "n" bytes of "buf" to position "pos".
+ */
+bool
+flush(int fd, const unsigned char *buf, size_t n, uint_fast64_t pos)
+{
+	ssize_t r;
+
+	while (n) {
+		if ((r = pwrite(fd, buf, n, pos)) < 0) {
+			if (errno == EINTR)
+				continue;
+			err("Failed to write to \"%s\": %s", params.patch,
+					strerror(errno));
+			return false;
+		}
+		buf += r;
+		n -= r;
+		pos += r;
+	}
+	return true;
+}
+
+/*
+ * Decode the values of "line" (after the offset) up to the ASCII column or
+ * the end of the line into "out". Incomplete values are taken as if they had
+ * leading zeros, like in reverse mode.
+ *
+ * return number of bytes decoded.
+ */
+size_t
+parse_line(const char *line, unsigned char *out, unsigned long number)
+{
+	const char *ptr;
+	unsigned v = 0, digits = 0;
+	size_t n = 0;
+
+	for (;; line++) {
+		if (*line && (ptr = strchr(type.characters, *line))) {
+			v = (digits ? v*type.base : 0)+(ptr-type.characters);
+			if (v > UCHAR_MAX || ++digits > type.char_width)
+				die("line %lu: value too big.", number);
+			continue;
+		}
+		if (digits)
+			out[n++] = v;
+		digits = 0;
+
+		if (!*line || *line == '\n' || *line == '|')
+			break;
+		else if (*line != ' ' && *line != '\t' && *line != '\r')
+			die("line %lu: invalid character -- \"%c\".", number,
+					*line);
+	}
+
+	return n;
+}
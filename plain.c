@@ -0,0 +1,326 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Plain mode (option "-p"): a continuous stream of digits without offsets,
+ * spaces, ascii column or masking, optionally wrapped after every
+ * "params.width" bytes. Meant for other programs, not for humans, so we
+ * convert whole blocks of "bufsize" bytes at once.
+ */
+
+#include <inttypes.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <tmmintrin.h>
+#endif
+
+#include "arena.h"
+#include "checksum.h"
+#include "io.h"
+#include "plain.h"
+#include "progress.h"
+#include "repository.h"
+#include "tune.h"
+#include "util.h"
+/* last */
+#include "ndc.h"
+
+
+static char    *convert_table(char *out, const unsigned char *in, size_t n);
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+static char    *convert_hex_ssse3(char *out, const unsigned char *in, size_t n);
+#endif
+static size_t   output_size(size_t n);
+
+
+/* number of output blocks handed to an output pipe, cf. dump_plain() */
+#define RING_COUNT  4
+
+
+/*
+ * table      string representation of every possible byte value, each one
+ *              "type.char_width" characters long (+1 for the trailing space
+ *              written by byte_to_numeric())
+ * value      numeric value of every character of "type.characters", -1 for
+ *              all other characters
+ * convert    kernel to convert a run of bytes: the fastest one the CPU
+ *              supports, unless the profile prefers another (cf. tune.c)
+ * ring       RING_COUNT output blocks for io_splice(), never freed, as the
+ *              pipe may still reference them when we are done
+ * ring_pipe  pipe capacity "ring" has been sized for
+ * ring_len   length of every block of "ring"
+ * ring_next  index of the next block of "ring" to use
+ */
+static char         table[(UCHAR_MAX+1)*CHAR_BIT+1];
+static signed char  value[UCHAR_MAX+1];
+static char *     (*convert)(char *out, const unsigned char *in, size_t n) =
+	convert_table;
+static char        *ring;
+static size_t       ring_pipe;
+static size_t       ring_len;
+static unsigned     ring_next;
+
+
+/*
+ * Convert "n" bytes using the lookup table. Specialize the common widths so
+ * that the compiler can turn the memcpy() into a single move.
+ *
+ * return pointer to index after last character written.
+ */
+char *
+convert_table(char *out, const unsigned char *in, size_t n)
+{
+	unsigned cw = type.char_width;
+
+	switch (cw) {
+	case 2:
+		for (; n--; out += 2)
+			memcpy(out, table+2*(*in++), 2);
+		break;
+	case 3:
+		for (; n--; out += 3)
+			memcpy(out, table+3*(*in++), 3);
+		break;
+	default:
+		for (; n--; out += cw)
+			memcpy(out, table+cw*(*in++), cw);
+		break;
+	}
+
+	return out;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+/*
+ * Convert 16 bytes at once to 32 hex characters by using both nibbles of
+ * every byte as index into "type.characters". The rest goes through the table.
+ * Compiled for SSSE3 whatever the target of the build, so only call it if
+ * tune_simd() says so.
+ */
+__attribute__((target("ssse3")))
+char *
+convert_hex_ssse3(char *out, const unsigned char *in, size_t n)
+{
+	const __m128i chars = _mm_loadu_si128((const __m128i *)type.characters);
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	__m128i v, hi, lo;
+
+	for (; n >= 16; n -= 16, in += 16, out += 32) {
+		v = _mm_loadu_si128((const __m128i *)in);
+		hi = _mm_shuffle_epi8(chars,
+				_mm_and_si128(_mm_srli_epi16(v, 4), mask));
+		lo = _mm_shuffle_epi8(chars, _mm_and_si128(v, mask));
+		_mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i *)(out+16), _mm_unpackhi_epi8(hi, lo));
+	}
+
+	return convert_table(out, in, n);
+}
+#endif
+
+/*
+ * May be called multiple times if there are multiple files to process.
+ * Every output block holds the digits of one input block plus the newlines
+ * inserted at the wrap column (at most one per "params.width" bytes and one
+ * for the line continued from the previous block).
+ *
+ * If the output is a pipe, complete blocks are handed to it by io_splice()
+ * instead of being copied. The pipe may reference a block until the reader
+ * has consumed it, so they come from "ring" and are sized to half of the
+ * pipe capacity: when a block is reused, the RING_COUNT-1 blocks after it
+ * have pushed it out of the pipe. The ring cannot be replaced for the same
+ * reason, so blocks it is too small for (another type, width or pipe of a
+ * later file or request of the server) are written without it.
+ */
+bool
+dump_plain(FILE *input, FILE *output)
+{
+	unsigned char *in;
+	char *o, *out, *start;
+	size_t block, i, len, n, out_len, pipe, run;
+	uint_fast64_t processed = 0;
+	unsigned col = 0;
+	bool written = false;
+
+	if (skip_offset(input) == EOF)
+		return true;
+
+	block = bufsize;
+	if ((pipe = io_splice_size(output))) {
+		block = pipe/2/type.char_width;
+		if (ring && (pipe > ring_pipe || output_size(block) > ring_len)) {
+			block = bufsize;
+			pipe = 0;
+		}
+	}
+	out_len = output_size(block);
+
+	if (pipe && !ring) {
+		ring = _malloc(RING_COUNT*out_len);
+		ring_pipe = pipe;
+		ring_len = out_len;
+	}
+	in = arena_block(ARENA_IN, block);
+	out = arena_block(ARENA_OUT, out_len);
+
+	for (;;) {
+		len = block;
+		if (params.limited && params.limit-processed < len)
+			len = params.limit-processed;
+		if (!len || !(n = fread(in, 1, len, input)))
+			break;
+		processed += n;
+		if (params.checksum)
+			checksum_update(in, n);
+		if (progress_due)
+			progress_report(processed);
+
+		/* only complete blocks are big enough for the ring */
+		start = pipe && n == block ?
+			ring+(ring_next++ % RING_COUNT)*ring_len : out;
+		if (!params.width) {
+			o = convert(start, in, n);
+		} else {
+			for (o = start, i = 0; i < n; i += run) {
+				run = params.width-col < n-i ? params.width-col : n-i;
+				o = convert(o, in+i, run);
+				if ((col += run) == params.width) {
+					*o++ = '\n';
+					col = 0;
+				}
+			}
+		}
+		if (start != out)
+			io_splice(output, start, o-start);
+		else
+			fwrite(out, 1, o-out, output);
+		written = true;
+	}
+	if (written && (col || !params.width))
+		fputc('\n', output);
+	progress_end(processed);
+
+	/* clear used memory */
+	memset(in, 0, block);
+	memset(out, 0, out_len);
+	/* the blocks are kept for the next file, cf. arena.c */
+
+	return ferror(input) ? false : true;
+}
+
+/*
+ * Strict counterpart of dump_plain(): every "type.char_width" digits form one
+ * byte, only newlines may appear in between.
+ * May be called multiple times if there are multiple files to process.
+ */
+bool
+dump_reverse_plain(FILE *input, FILE *output)
+{
+	char *in;
+	unsigned char *out, *o;
+	size_t i, n;
+	uint_fast64_t byte_count = 0, processed = 0, skip = params.skip;
+	unsigned acc = 0, count = 0;
+	bool done = false;
+
+	in = arena_block(ARENA_IN, bufsize);
+	out = arena_block(ARENA_OUT, bufsize/type.char_width+1);
+
+	while (!done && (n = fread(in, 1, bufsize, input))) {
+		processed += n;
+		if (progress_due)
+			progress_report(processed);
+		for (o = out, i = 0; i < n; i++) {
+			if (value[(unsigned char)in[i]] < 0) {
+				if (in[i] == '\n')
+					continue;
+				die("error: invalid character -- \"%c\".", in[i]);
+			}
+			acc = acc*type.base + value[(unsigned char)in[i]];
+			if (++count != type.char_width)
+				continue;
+			count = 0;
+			if (skip) {
+				skip--;
+			} else if (params.limited && byte_count++ == params.limit) {
+				done = true;
+				break;
+			} else {
+				*o++ = acc;
+			}
+			acc = 0;
+		}
+		fwrite(out, 1, o-out, output);
+		if (params.checksum)
+			checksum_update(out, o-out);
+	}
+	if (count && !done)
+		die("error: incomplete value at end of input.");
+	progress_end(processed);
+
+	/* clear used memory */
+	memset(in, 0, bufsize);
+	memset(out, 0, bufsize/type.char_width+1);
+	/* the blocks are kept for the next file, cf. arena.c */
+
+	return ferror(input) ? false : true;
+}
+
+/*
+ * Build the lookup tables for the current type and choose the kernel.
+ * Must be called after init() has chosen "byte_to_numeric".
+ */
+void
+init_plain(void)
+{
+	unsigned char c;
+	unsigned i;
+
+	for (i = 0; i <= UCHAR_MAX; i++) {
+		c = i;
+		byte_to_numeric(table+i*type.char_width, &c, 1);
+	}
+
+	memset(value, -1, sizeof(value));
+	for (i = 0; i < type.base && type.characters[i]; i++)
+		value[(unsigned char)type.characters[i]] = i;
+
+	convert = convert_table;
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	if (type.base == 16 && tune_simd(KERNEL_PLAIN_HEX))
+		convert = convert_hex_ssse3;
+#endif
+}
+
+/*
+ * Size of the output of "n" bytes: their digits plus the newlines inserted at
+ * the wrap column.
+ */
+size_t
+output_size(size_t n)
+{
+	return n*type.char_width + (params.width ? n/params.width+1 : 0);
+}
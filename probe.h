@@ -0,0 +1,74 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Static probe points ("USDT", like <sys/sdt.h> of SystemTap, which is not
+ * needed): every PROBE2() is a nop at the probed place plus an entry in the
+ * ELF note section ".note.stapsdt" naming the provider "ndc", the probe and
+ * where to find its two 64-bit arguments. perf ("perf probe sdt_ndc:read")
+ * and bpftrace ("usdt:./ndc:ndc:read") attach to them in any build; unused,
+ * they cost the nop and keeping the arguments in registers.
+ *
+ * Probes of the dump (cf. DumpState.c):
+ *   read       offset, number of bytes read
+ *   translate  offset, number of bytes translated
+ *   write      position in the output, number of characters written
+ *   mask       offset of the first line replaced by "*", its number of bytes
+ *
+ * Only on x86-64 ELF systems with GNU C, elsewhere they are left out.
+ */
+
+#ifndef PROBE_H
+#define PROBE_H
+
+
+#if defined(__x86_64__) && defined(__ELF__) && defined(__GNUC__)
+#define PROBE2(name, arg1, arg2) \
+	__asm__ __volatile__ ( \
+		"990:	nop\n" \
+		"	.pushsection .note.stapsdt,\"?\",\"note\"\n" \
+		"	.balign 4\n" \
+		"	.4byte 992f-991f, 994f-993f, 3\n" \
+		"991:	.asciz \"stapsdt\"\n" \
+		"992:	.balign 4\n" \
+		"993:	.8byte 990b\n" \
+		"	.8byte _.stapsdt.base\n" \
+		"	.8byte 0\n" \
+		"	.asciz \"ndc\"\n" \
+		"	.asciz \"" #name "\"\n" \
+		"	.asciz \"8@%0 8@%1\"\n" \
+		"994:	.balign 4\n" \
+		"	.popsection\n" \
+		"	.ifndef _.stapsdt.base\n" \
+		"	.pushsection .stapsdt.base,\"aG\",\"progbits\"," \
+			".stapsdt.base,comdat\n" \
+		"	.weak _.stapsdt.base\n" \
+		"	.hidden _.stapsdt.base\n" \
+		"_.stapsdt.base:	.space 1\n" \
+		"	.size _.stapsdt.base, 1\n" \
+		"	.popsection\n" \
+		"	.endif\n" \
+		: : "nor" ((uint64_t)(arg1)), "nor" ((uint64_t)(arg2)))
+#else
+#define PROBE2(name, arg1, arg2)  ((void)(arg1), (void)(arg2))
+#endif
+
+
+#endif /* PROBE_H */
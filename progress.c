@@ -0,0 +1,155 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Progress reports on stderr (option "-g SECONDS" and SIGUSR1, like dd):
+ * bytes processed of the current file, the percentage of its size or of
+ * "-l", the throughput since the last report and the estimated time left.
+ *
+ * The signal handlers (SIGUSR1 and, every "-g" seconds, SIGALRM) only set
+ * "progress_due", which every mode tests once per block it reads (about
+ * "bufsize" bytes; a line in foreign dumps, cf. foreign.c), so the reports
+ * cost nothing until one is due; "-j" reports per chunk of completed lines
+ * (cf. parallel.c). In reverse mode, the bytes are those of the input. "-S"
+ * and "-P" do not report.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "progress.h"
+#include "repository.h"
+#include "util.h"
+/* last */
+#include "ndc.h"
+
+
+static void  handle_signal(int sig);
+
+
+/* define "progress_due", declared in "progress.h" */
+volatile sig_atomic_t progress_due = 0;
+
+/* private variables */
+/*
+ * name      name of the current input
+ * total     number of bytes to process, 0 = unknown
+ * last      bytes processed at the last report
+ * then      time of the last report
+ */
+static struct {
+	const char *name;
+	uint_fast64_t total;
+	uint_fast64_t last;
+	double then;
+} progress;
+
+
+void
+handle_signal(int sig)
+{
+	if (sig == SIGALRM)
+		alarm(params.progress);
+	progress_due = 1;
+}
+
+/*
+ * Start reporting on the input "input" (named "name", NULL if its size is
+ * unknown): handle SIGUSR1 and, with "-g", (re)start the timer.
+ */
+void
+progress_begin(const char *name, FILE *input)
+{
+	struct sigaction sa;
+	struct stat st;
+	int fd;
+
+	progress.name = name;
+	progress.total = 0;
+	if (input && (fd = fileno(input)) >= 0 && !fstat(fd, &st)
+			&& S_ISREG(st.st_mode))
+		progress.total = st.st_size;
+	/* "-s" and "-l" count the bytes of the output in reverse mode */
+	if (!params.reverse) {
+		progress.total = progress.total > params.skip ?
+			progress.total-params.skip : 0;
+		if (params.limited && (!progress.total
+					|| params.limit < progress.total))
+			progress.total = params.limit;
+	}
+	progress.last = 0;
+	progress.then = seconds();
+
+	/* restart reads and writes interrupted by the signals */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handle_signal;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGUSR1, &sa, NULL);
+	if (params.progress)
+		sigaction(SIGALRM, &sa, NULL);
+	/* without "-g", a timer left by an earlier request is cancelled */
+	alarm(params.progress);
+	progress_due = 0;
+}
+
+/*
+ * With "-g", report the end of the input ("processed" bytes). The timer keeps
+ * running for the next file (or range of "-M"); progress_begin() restarts it.
+ */
+void
+progress_end(uint_fast64_t processed)
+{
+	if (params.progress)
+		progress_report(processed);
+}
+
+/* Report "processed" bytes of the current input. */
+void
+progress_report(uint_fast64_t processed)
+{
+	double now = seconds(), rate, left;
+	unsigned long eta;
+
+	progress_due = 0;
+	rate = now > progress.then ?
+		(processed-progress.last)/(now-progress.then) : 0;
+	progress.last = processed;
+	progress.then = now;
+
+	if (!progress.total) {
+		err("%s: %"PRIuFAST64" bytes, %.1f MB/s", progress.name,
+				processed, rate/1e6);
+		return;
+	}
+	left = progress.total > processed ? progress.total-processed : 0;
+	eta = rate > 0 ? left/rate+0.5 : 0;
+	err("%s: %"PRIuFAST64" bytes (%.1f%%), %.1f MB/s, %lu:%02lu:%02lu left",
+			progress.name, processed, 100.0*processed/progress.total,
+			rate/1e6, eta/3600, eta/60%60, eta%60);
+}
@@ -0,0 +1,33 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+
+/* set when a report is due, cf. progress.c */
+extern volatile sig_atomic_t progress_due;
+
+void  progress_begin(const char *name, FILE *input);
+void  progress_end(uint_fast64_t processed);
+void  progress_report(uint_fast64_t processed);
+
+
+#endif /* PROGRESS_H */
@@ -0,0 +1,368 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Sampling mode (option "-S SPEC"): dump only some lines of a seekable input,
+ * in order to get an idea of the layout of a huge file without reading all of
+ * it. SPEC is one of:
+ *
+ *   step:N            every Nth line
+ *   random:K[:SEED]   K random lines (the same for the same SEED)
+ *   probe:N           the first and the last N lines and N lines evenly
+ *                     spaced in between
+ *
+ * A line consists of "-w" bytes, counted from "-s" up to "-l". Every line is
+ * fetched by its own positional read and printed with its true offset; a
+ * line "--" separates lines which are not contiguous. The lines of "step"
+ * and "probe" are computed one after the other, only the ones of "random"
+ * are drawn and sorted in advance.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "arena.h"
+#include "checksum.h"
+#include "progress.h"
+#include "repository.h"
+#include "sample.h"
+#include "util.h"
+/* last */
+#include "ndc.h"
+
+
+static int            compare(const void *a, const void *b);
+static bool           next_line(uint_fast64_t *line);
+static uint_fast64_t  next_random(uint_fast64_t *state);
+static void           select_lines(uint_fast64_t count);
+static size_t         unique(uint_fast64_t *lines, size_t len);
+
+
+/* private variables */
+/*
+ * mode      mode of "-S", SAMPLE_STEP (by 1) if "random" selects every line
+ * n         number of "-S", at most "count"
+ * count     number of lines
+ * lines     lines drawn by "random" (ascending, without duplicates)
+ * len       number of elements of "lines"
+ * i         number of lines returned by next_line()
+ * next      next line of "step" and "probe"
+ * k         next of the "n" evenly spaced lines of "probe"
+ */
+static struct {
+	enum Sample mode;
+	uint_fast64_t n;
+	uint_fast64_t count;
+	uint_fast64_t *lines;
+	size_t len;
+	uint_fast64_t i;
+	uint_fast64_t next;
+	uint_fast64_t k;
+} selection;
+
+
+int
+compare(const void *a, const void *b)
+{
+	uint_fast64_t x = *(const uint_fast64_t *)a, y = *(const uint_fast64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * Dump the lines selected by select_lines(). "input" has to be a regular file
+ * (or a block device), as it is not read sequentially.
+ *
+ * return false on read errors.
+ */
+bool
+dump_sample(FILE *input, FILE *output)
+{
+	struct stat st;
+	uint_fast64_t count, end, line, last = 0, pos;
+	unsigned char *in;
+	char *out, *eol, *after_offset, *after_dump;
+	unsigned out_len;
+	bool first = true;
+	ssize_t r;
+	int fd = fileno(input);
+	bool success = true;
+
+	if (fstat(fd, &st) || !(S_ISREG(st.st_mode) || S_ISBLK(st.st_mode))) {
+		err("Sampling needs a seekable input.");
+		return false;
+	}
+	if (S_ISBLK(st.st_mode)) {
+		if ((st.st_size = lseek(fd, 0, SEEK_END)) < 0)
+			return false;
+	}
+
+	if ((end = (uint_fast64_t)st.st_size) <= params.skip) {
+		fprintf(output, "EOF reached after skipping %"SCNuFAST64" bytes.\n",
+				params.skip);
+		return true;
+	} else if (params.limited && end-params.skip > params.limit) {
+		end = params.skip+params.limit;
+	}
+	count = (end-params.skip+params.width-1)/params.width;
+	select_lines(count);
+
+	in = arena_block(ARENA_IN, params.width);
+	out_len = OFFSET_CHAR_LEN+params.width*(type.char_width+type.space)
+		+ params.width+5;
+	out = arena_block(ARENA_OUT, out_len);
+	after_offset = params.offset ? out+offset_len : out;
+	after_dump = after_offset+params.width*(type.char_width+type.space)
+		- (type.space ? 1 : 0);
+
+	while (next_line(&line)) {
+		pos = params.skip+line*params.width;
+		r = pread(fd, in, end-pos < params.width ? end-pos : params.width,
+				pos);
+		if (r <= 0) {
+			success = false;
+			break;
+		}
+		if (params.checksum)
+			checksum_update(in, r);
+		/* the sampled lines are sorted: report the position */
+		if (progress_due)
+			progress_report(pos+r-params.skip);
+
+		if (!first && line != last+1)
+			fputs("--\n", output);
+		first = false;
+		last = line;
+
+		if (params.offset)
+			get_offset(out, pos);
+		eol = byte_to_numeric(after_offset, in, r);
+		if (params.ascii_col) {
+			while (eol < after_dump)
+				*eol++ = ' ';
+			eol = append_ascii_col(after_dump, in, r);
+		} else {
+			*eol++ = '\n';
+		}
+		fwrite(out, 1, eol-out, output);
+	}
+
+	progress_end(end-params.skip);
+
+	/* the last offset (= end of the sampled range) like in dump() */
+	if (params.offset) {
+		get_offset(out, end);
+		if (params.checksum) {
+			fwrite(out, 1, offset_len, output);
+			checksum_print(output);
+		} else {
+			out[offset_len] = '\n';
+			fwrite(out, 1, offset_len+1, output);
+		}
+	} else if (params.checksum) {
+		checksum_print(output);
+	}
+
+	/* clear used memory */
+	memset(in, 0, params.width);
+	memset(out, 0, out_len);
+	if (selection.len)
+		memset(selection.lines, 0, selection.len*sizeof(*selection.lines));
+	/* the blocks are kept for the next file, cf. arena.c */
+
+	return success;
+}
+
+/*
+ * Next line selected by select_lines() to "*line".
+ *
+ * return false if there is none.
+ */
+bool
+next_line(uint_fast64_t *line)
+{
+	uint_fast64_t n = selection.n, count = selection.count, tail, k;
+
+	switch (selection.mode) {
+	case SAMPLE_RANDOM:
+		if (selection.i >= selection.len)
+			return false;
+		*line = selection.lines[selection.i];
+		break;
+	case SAMPLE_PROBE:
+		/* the first and last "n" lines, the evenly spaced ones between */
+		if (selection.next >= count)
+			return false;
+		tail = count-n;
+		*line = selection.next;
+		if (*line >= n && *line < tail) {
+			/* k*count/(n+1) without overflowing k*count */
+			for (k = selection.k; k <= n; k++) {
+				*line = k*(count/(n+1)) + k*(count%(n+1))/(n+1);
+				if (*line >= selection.next)
+					break;
+			}
+			selection.k = k;
+			if (k > n || *line > tail)
+				*line = tail;
+		}
+		selection.next = *line+1;
+		break;
+	default: /* SAMPLE_STEP */
+		if (selection.next >= count)
+			return false;
+		*line = selection.next;
+		selection.next += n;
+		break;
+	}
+	selection.i++;
+
+	return true;
+}
+
+/*
+ * splitmix64 - good enough to pick lines and, unlike rand(), the same
+ * everywhere for the same seed.
+ */
+uint_fast64_t
+next_random(uint_fast64_t *state)
+{
+	uint64_t z = (*state += UINT64_C(0x9E3779B97F4A7C15));
+
+	z = (z ^ (z >> 30))*UINT64_C(0xBF58476D1CE4E5B9);
+	z = (z ^ (z >> 27))*UINT64_C(0x94D049BB133111EB);
+	return z ^ (z >> 31);
+}
+
+/*
+ * Parse SPEC of option "-S" (cf. top of file) into "params".
+ *
+ * return false if SPEC is invalid.
+ */
+bool
+sample_parse(const char *spec)
+{
+	static const struct {
+		const char *name;
+		enum Sample mode;
+	} known[] = {
+		{ "probe",  SAMPLE_PROBE },
+		{ "random", SAMPLE_RANDOM },
+		{ "step",   SAMPLE_STEP },
+	};
+	const char *arg;
+	char *end;
+	unsigned i;
+
+	if (!(arg = strchr(spec, ':')) || strchr(spec, '-'))
+		return false;
+	for (i = 0; i < sizeof(known)/sizeof(*known); i++) {
+		if (strlen(known[i].name) == (size_t)(arg-spec)
+				&& !strncmp(spec, known[i].name, arg-spec))
+			break;
+	}
+	if (i == sizeof(known)/sizeof(*known))
+		return false;
+	params.sample = known[i].mode;
+
+	errno = 0;
+	params.sample_count = strtoull(arg+1, &end, 10);
+	if (errno || end == arg+1 || !params.sample_count)
+		return false;
+
+	params.sample_seed = 0;
+	if (*end == ':' && params.sample == SAMPLE_RANDOM) {
+		arg = end+1;
+		params.sample_seed = strtoull(arg, &end, 10);
+		if (errno || end == arg)
+			return false;
+	}
+
+	return !*end;
+}
+
+/*
+ * Select the lines to dump out of "count" lines for next_line(). Only the
+ * ones of "random" are stored (in an arena block).
+ */
+void
+select_lines(uint_fast64_t count)
+{
+	uint_fast64_t n = params.sample_count, state = params.sample_seed;
+	size_t len;
+
+	memset(&selection, 0, sizeof(selection));
+	selection.mode = params.sample;
+	/* all of them */
+	if (selection.mode == SAMPLE_RANDOM && n >= count) {
+		selection.mode = SAMPLE_STEP;
+		n = 1;
+	}
+	/* more would not select other lines, but underflow "count-n" */
+	if (n > count)
+		n = count;
+	selection.n = n;
+	selection.count = count;
+	selection.k = 1;
+
+	if (selection.mode != SAMPLE_RANDOM)
+		return;
+	selection.lines = arena_block(ARENA_LINES, n*sizeof(*selection.lines));
+	/* draw the missing lines until there are no duplicates */
+	for (len = 0; len < n; len = unique(selection.lines, len)) {
+		while (len < n)
+			selection.lines[len++] = next_random(&state)%count;
+	}
+	selection.len = len;
+}
+
+/*
+ * Sort the "len" elements of "lines" and remove duplicates.
+ *
+ * return new number of elements
+ */
+size_t
+unique(uint_fast64_t *lines, size_t len)
+{
+	size_t i, j;
+
+	if (!len)
+		return 0;
+
+	qsort(lines, len, sizeof(*lines), compare);
+	for (i = 1, j = 1; i < len; i++) {
+		if (lines[i] != lines[j-1])
+			lines[j++] = lines[i];
+	}
+
+	return j;
+}
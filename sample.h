@@ -0,0 +1,38 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SAMPLE_H
+#define SAMPLE_H
+
+
+/* which lines to sample (option "-S"), cf. sample.c */
+enum Sample {
+	SAMPLE_NONE = 0,
+	SAMPLE_PROBE,
+	SAMPLE_RANDOM,
+	SAMPLE_STEP,
+};
+
+
+bool  dump_sample(FILE *input, FILE *output);
+bool  sample_parse(const char *spec);
+
+
+#endif /* SAMPLE_H */
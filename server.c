@@ -0,0 +1,400 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Server and client (options "-U PATH" and "-u PATH"): the server listens on
+ * the UNIX socket PATH with a pool of "-j" worker processes, which are forked
+ * once and serve one request after the other, so that a request costs neither
+ * a process start nor the initialization of ndc. A worker that dies (e.g. on
+ * an invalid request, cf. die()) is replaced.
+ *
+ * The client passes its standard input, output and error (SCM_RIGHTS) along
+ * with the length of the rest of the request (uint32_t, host byte order). The
+ * rest of the request are the working directory of the client and the command
+ * line arguments, all terminated by '\0'. The worker processes the arguments
+ * just like main() does, reading and writing the descriptors of the client
+ * directly, and replies with the exit status (one byte). If the worker dies,
+ * the client gets no status and fails.
+ *
+ * The socket is created with mode 0600: a request runs with the privileges of
+ * the server, so only the user of the server may send requests.
+ */
+
+/* CMSG_SPACE() and CMSG_LEN() */
+#define _DEFAULT_SOURCE
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#if defined(__GLIBC__)
+#include <stdio_ext.h>
+#endif
+
+#include "io.h"
+#include "repository.h"
+#include "server.h"
+#include "util.h"
+/* last */
+#include "ndc.h"
+
+
+/* maximum length of a request without payload */
+#define REQUEST_MAX  (1 << 16)
+
+
+/* set by handle_signal(): the server has to stop */
+static volatile sig_atomic_t stop = 0;
+
+
+static void  address(struct sockaddr_un *addr, const char *path);
+static void  handle_signal(int sig);
+static bool  read_full(int fd, void *buf, size_t n);
+static bool  recv_fds(int fd, void *buf, size_t n, int *fds);
+static bool  send_fds(int fd, const void *buf, size_t n);
+static void  serve(int conn);
+static pid_t spawn(int fd);
+static bool  write_full(int fd, const void *buf, size_t n);
+
+
+void
+address(struct sockaddr_un *addr, const char *path)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr->sun_path))
+		die("Socket path too long: %s", path);
+	strcpy(addr->sun_path, path);
+}
+
+void
+handle_signal(int sig)
+{
+	(void)sig;
+	stop = 1;
+}
+
+/*
+ * Send the request (all arguments but the program name; "-u PATH" is ignored
+ * by the server) and wait for the exit status.
+ *
+ * return exit status
+ */
+int
+client(const char *path, int argc, char * const *argv)
+{
+	struct sockaddr_un addr;
+	char *buf, cwd[4096];
+	size_t len, n;
+	uint32_t size;
+	unsigned char status;
+	int fd, i;
+
+	address(&addr, path);
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0
+			|| connect(fd, (struct sockaddr *)&addr, sizeof(addr)))
+		die("Failed to connect to \"%s\": %s", path, strerror(errno));
+
+	if (!getcwd(cwd, sizeof(cwd)))
+		die("getcwd: %s", strerror(errno));
+	for (len = strlen(cwd)+1, i = 1; i < argc; i++)
+		len += strlen(argv[i])+1;
+	if (len > REQUEST_MAX)
+		die("Too many arguments.");
+
+	buf = _malloc(len);
+	for (n = 0, i = 0; i < argc; i++) {
+		strcpy(buf+n, i ? argv[i] : cwd);
+		n += strlen(buf+n)+1;
+	}
+	size = len;
+	if (!send_fds(fd, &size, sizeof(size)) || !write_full(fd, buf, len))
+		die("Failed to send the request: %s", strerror(errno));
+	free(buf);
+
+	if (!read_full(fd, &status, 1))
+		die("The server failed to process the request.");
+	close(fd);
+
+	return status;
+}
+
+bool
+read_full(int fd, void *buf, size_t n)
+{
+	ssize_t r;
+
+	while (n) {
+		if ((r = read(fd, buf, n)) <= 0) {
+			if (r < 0 && errno == EINTR)
+				continue;
+			return false;
+		}
+		buf = (char *)buf+r;
+		n -= r;
+	}
+	return true;
+}
+
+/*
+ * Receive "n" bytes to "buf" along with the three descriptors sent by
+ * send_fds().
+ */
+bool
+recv_fds(int fd, void *buf, size_t n, int *fds)
+{
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(3*sizeof(int))];
+	} ctl;
+	struct iovec iov = { .iov_base = buf, .iov_len = n };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = ctl.buf,
+		.msg_controllen = sizeof(ctl.buf)
+	};
+	struct cmsghdr *cmsg;
+
+	if (recvmsg(fd, &msg, 0) != (ssize_t)n)
+		return false;
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (!cmsg || cmsg->cmsg_level != SOL_SOCKET
+			|| cmsg->cmsg_type != SCM_RIGHTS
+			|| cmsg->cmsg_len != CMSG_LEN(3*sizeof(int)))
+		return false;
+	memcpy(fds, CMSG_DATA(cmsg), 3*sizeof(int));
+
+	return true;
+}
+
+/*
+ * Send "n" bytes from "buf" along with standard input, output and error.
+ */
+bool
+send_fds(int fd, const void *buf, size_t n)
+{
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(3*sizeof(int))];
+	} ctl;
+	struct iovec iov = { .iov_base = (void *)buf, .iov_len = n };
+	struct msghdr msg = {
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = ctl.buf,
+		.msg_controllen = sizeof(ctl.buf)
+	};
+	struct cmsghdr *cmsg;
+	int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+
+	memset(ctl.buf, 0, sizeof(ctl.buf));
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(3*sizeof(int));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	return sendmsg(fd, &msg, 0) == (ssize_t)n;
+}
+
+/*
+ * Handle one request (cf. top of file) on the connection "conn".
+ */
+void
+serve(int conn)
+{
+	static char req[REQUEST_MAX];
+	static char *argv[REQUEST_MAX/2+2];
+	uint32_t size;
+	size_t n;
+	unsigned char status = EXIT_SUCCESS;
+	int argc, fds[3], i, null, r;
+
+	if (!recv_fds(conn, &size, sizeof(size), fds))
+		goto out;
+	if (!size || size > REQUEST_MAX || !read_full(conn, req, size)
+			|| req[size-1])
+		goto close_fds;
+
+	/* argv[0] is the program name, the first string the directory */
+	argv[0] = NAME_STR;
+	for (argc = 1, n = strlen(req)+1; n < size; n += strlen(req+n)+1)
+		argv[argc++] = req+n;
+	argv[argc] = NULL;
+
+	for (i = 0; i < 3; i++) {
+		if (dup2(fds[i], i) < 0)
+			die("dup2: %s", strerror(errno));
+	}
+	clearerr(stdin);
+	clearerr(stdout);
+
+	if (chdir(req)) {
+		err("Failed to change to \"%s\": %s", req, strerror(errno));
+		status = EXIT_FAILURE;
+	} else if ((r = parse_options(argc, argv)) != -1) {
+		status = r; /* e.g. "-h" */
+	} else if (params.server) {
+		err("Will not start a server on behalf of a client.");
+		status = EXIT_FAILURE;
+	} else if (params.calibrate) {
+		err("Will not calibrate on behalf of a client.");
+		status = EXIT_FAILURE;
+	} else if (!run(argc, argv)) {
+		status = EXIT_FAILURE;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+	/* do not let unread input leak into the next request */
+#if defined(__GLIBC__)
+	__fpurge(stdin);
+#endif
+
+	/* let go of the descriptors of the client */
+	if ((null = open("/dev/null", O_RDWR)) < 0)
+		die("Failed to open /dev/null: %s", strerror(errno));
+	for (i = 0; i < 3; i++)
+		dup2(null, i);
+	close(null);
+
+	write_full(conn, &status, 1);
+close_fds:
+	for (i = 0; i < 3; i++)
+		close(fds[i]);
+out:
+	close(conn);
+}
+
+/*
+ * Listen on "path" and keep "params.jobs" workers running until SIGINT or
+ * SIGTERM.
+ */
+void
+server(const char *path)
+{
+	struct sigaction sa;
+	struct sockaddr_un addr;
+	struct stat st;
+	pid_t pid, *workers;
+	mode_t mask;
+	unsigned i;
+	int fd, r;
+
+	address(&addr, path);
+	/* remove the socket of an earlier server */
+	if (!stat(path, &st) && S_ISSOCK(st.st_mode))
+		unlink(path);
+
+	/*
+	 * Requests are served with the privileges of the server (e.g. "-d"
+	 * writes any file it may write), so only its user may connect.
+	 */
+	if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+		die("Failed to listen on \"%s\": %s", path, strerror(errno));
+	mask = umask(0177);
+	r = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+	umask(mask);
+	if (r || listen(fd, SOMAXCONN))
+		die("Failed to listen on \"%s\": %s", path, strerror(errno));
+
+	/* no SA_RESTART: wait() has to return */
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = handle_signal;
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	workers = _malloc(params.jobs*sizeof(*workers));
+	for (i = 0; i < params.jobs; i++)
+		workers[i] = spawn(fd);
+
+	while (!stop) {
+		if ((pid = wait(NULL)) < 0 && errno != EINTR)
+			die("wait: %s", strerror(errno));
+		for (i = 0; i < params.jobs && !stop; i++) {
+			if (workers[i] == pid)
+				workers[i] = spawn(fd);
+		}
+	}
+
+	for (i = 0; i < params.jobs; i++)
+		kill(workers[i], SIGTERM);
+	while (wait(NULL) > 0 || errno == EINTR);
+	unlink(path);
+	exit(EXIT_SUCCESS);
+}
+
+/*
+ * Fork a worker serving requests on the listening socket "fd".
+ *
+ * return pid of the worker
+ */
+pid_t
+spawn(int fd)
+{
+	pid_t pid;
+	int conn;
+
+	if ((pid = fork()) < 0)
+		die("fork: %s", strerror(errno));
+	else if (pid)
+		return pid;
+
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	io_setup_std();
+	for (;;) {
+		if ((conn = accept(fd, NULL, NULL)) >= 0)
+			serve(conn);
+		else if (errno != EINTR)
+			die("accept: %s", strerror(errno));
+	}
+}
+
+bool
+write_full(int fd, const void *buf, size_t n)
+{
+	ssize_t r;
+
+	while (n) {
+		if ((r = write(fd, buf, n)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		buf = (const char *)buf+r;
+		n -= r;
+	}
+	return true;
+}
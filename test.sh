@@ -110,10 +110,37 @@ usage () {
     --nocolor        no colored output
     --valgrind       execute test using valgrind
   tests available:
+    analysis            check byte histogram of analysis mode ("-e" option)
+    arena               check that several files in one run, reusing the
+                        buffers, give the same output as one run per file
+    cache               check cached dump == dump, twice ("-C" option)
+    checkpoint          check resuming a dump from a checkpoint ("-k", "-K")
+    checksum            check sha256 of dump and reverse ("-c" option)
     check_format_ascii  check for correct number of ascii-characters ("-a" option)
-    check_offset_value  check correct last offset value (= file size)
+    check_offset_value  check correct last offset value (= file size), with
+                        and without "-o" and at the end of masked lines
+    compress            check dump of gzip-compressed input == dump and
+                        compressed dump == dump ("-z" option)
     default             default test set
+    dictionary          check dump+reverse with back-references ("-m" option)
+    foreign             check reverse of "od -tx1" and "xxd -a" dumps == original
+                        file
+    index               check reverse seeking with an index == rest of the file
+                        ("-I", "-i" options)
+    memory              check dump of process memory == /proc/PID/mem ("-M" option)
+    multi               check additional representation == separate dump
+                        ("-T" option)
+    parallel            check parallel dump == serial dump and parallel
+                        dump+reverse == original file ("-j" option)
+    patch               check patching a file of zeros with a dump ("-P" option)
+    plain               check plain dump+reverse == original file ("-p" option)
+    profile             check dump+reverse with the bufsize and threads of a
+                        host profile == original file ("-A" option)
+    progress            check the report at the end of every mode ("-g" option)
     reverse             check dump+reverse == original file
+    sample              check that a random sample is part of the full dump
+                        ("-S" option)
+    server              check dump+reverse through a server ("-U", "-u" options)
     skip_limit          only tests -l and -s options
     width               only tests -w option\n'
 }
@@ -122,6 +149,175 @@ usage () {
 ## test functions ##
 
 
+analysis () {
+	current_test_name="analysis"
+
+	before_test
+
+	block=$(shuf -n1 -i 1-32768)
+	default_dump_cmd -e "$block" -c sha256
+
+	# the counts of the summary histogram have to add up to the file size
+	size=$(stat -Lc '%s' "$file")
+	sum=$(sha256sum "$file" | cut -d' ' -f1)
+	ndc_sum=$(tail -n1 "$dump" | sed 's/^sha256=//')
+	count=$(sed -n '/^total:/,$p' "$dump" | grep '^  [0-9A-F]*:' \
+		| awk '{ for (i = 2; i <= NF; i++) n += $i } END { print n }')
+	blocks=$(grep -c '^ *[0-9]\.[0-9]' "$dump")
+
+	if [ "$size" != "$count" ]; then
+		print_red "$file: test $current_test_name failed; histogram "\
+			"should count $size bytes, but counted $count."
+		success=false
+	elif [ "$blocks" -ne $(((size+block-1)/block+1)) ]; then
+		print_red "$file: test $current_test_name failed; wrong number "\
+			"of blocks: $blocks."
+		success=false
+	elif [ "$sum" != "$ndc_sum" ]; then
+		print_red "$file: test $current_test_name failed; sha256 should "\
+			"be $sum, but was $ndc_sum."
+		success=false
+	else
+		print_green "$file: test $current_test_name passed."
+	fi
+}
+
+arena () {
+	current_test_name="arena"
+
+	before_test
+
+	# shorter files after a longer one find its content in the blocks
+	head -c 1000 "$file" > "$binary.short"
+	tail -c +4100 "$file" > "$binary.tail"
+	set -- "$file" "$binary.short" "$binary.tail"
+	for opts in "-m 65536 -a" "-p" "-e 4096" "-C $binary.cache" \
+			"-S random:16" "-T x:/dev/null"; do
+		printf '' > "$dump"
+		printf '' > "$binary"
+		printf '%s\n' "${debug_cmd}\"$bin\" $opts -t $type -d \"$dump\" $*"
+		$debug_cmd "$bin" $opts -t "$type" -d "$dump" "$@"
+		for f in "$@"; do
+			"$bin" $opts -t "$type" -d "$binary" "$f"
+		done
+		cmp -s "$dump" "$binary"
+		check_result $?
+	done
+
+	# the same in reverse mode, with back-references
+	for i in 1 2; do
+		printf '' > "$binary.$i"
+		[ $i -eq 1 ] && f="$file" || f="$binary.tail"
+		"$bin" -n -f -m 65536 -t "$type" -d "$binary.$i" "$f"
+		sed -i '1d' "$binary.$i"
+	done
+	set -- "$binary.1" "$binary.2"
+	printf '' > "$dump"
+	printf '' > "$binary"
+	printf '%s\n' "${debug_cmd}\"$bin\" -r -m 65536 -t $type -d \"$dump\" $*"
+	$debug_cmd "$bin" -r -m 65536 -t "$type" -d "$dump" "$@"
+	for f in "$@"; do
+		"$bin" -r -m 65536 -t "$type" -d "$binary" "$f"
+	done
+	cmp -s "$dump" "$binary"
+	check_result $?
+
+	rm -rf "$binary.short" "$binary.tail" "$binary.cache" "$binary.1" \
+		"$binary.2"
+}
+
+checkpoint () {
+	current_test_name="checkpoint"
+
+	before_test
+
+	# complete dump for comparison
+	printf '%s\n' "${debug_cmd}\"$bin\" -f -d \"$binary\" -t $type \"$file\""
+	$debug_cmd "$bin" -f -d "$binary" -t "$type" "$file"
+
+	# pretend to have been interrupted after a random line (plus garbage)
+	size=$(stat -Lc '%s' "$file")
+	lines=$(shuf -n1 -i 1-$(((size+15)/16-1)))
+	head -n $((lines+1)) "$binary" > "$dump"
+	output=$(stat -Lc '%s' "$dump")
+	printf 'garbage' >> "$dump"
+	old=$(od -An -tx1 -j $((lines*16-16)) -N16 "$file" | tr -d ' \n')
+	printf 'ndc checkpoint 1\nfile 0 %s\ninput %s\noutput %s\nprocessed %s
+offset %s\nmasked 0\nwritten 1\nskip 0\nbyte_count 0\nold %s\n' \
+		"$file" $((lines*16)) "$output" $((lines*16)) $((lines*16)) \
+		"$old" > "$dump.ck"
+
+	printf '%s\n' "${debug_cmd}\"$bin\" -f -k \"$dump.ck\" -K -d \"$dump\" -t $type \"$file\""
+	$debug_cmd "$bin" -f -k "$dump.ck" -K -d "$dump" -t "$type" "$file"
+
+	diff -q "$dump" "$binary" > /dev/null && [ ! -e "$dump.ck" ]
+	check_result $?
+
+	# really interrupted: the input is a FIFO that stops in the middle
+	# until the first checkpoint has been saved, then the run is killed
+	# and resumed on the complete file (of the same name)
+	printf '' > "$dump"
+	input="$dump.in"
+	rm -f "$input"
+	mkfifo "$input"
+	printf '%s\n' "NDC_CHECKPOINT_INTERVAL=1024 ${debug_cmd}\"$bin\" -b 512 -f -k \"$dump.ck\" -d \"$dump\" -t $type \"$input\" &"
+	NDC_CHECKPOINT_INTERVAL=1024 $debug_cmd "$bin" -b 512 -f -k "$dump.ck" \
+		-d "$dump" -t "$type" "$input" &
+	pid=$!
+	exec 3> "$input"
+	head -c $((size/2)) "$file" >&3
+	i=0
+	while [ ! -e "$dump.ck" ] && [ $i -lt 100 ]; do
+		sleep 0.1
+		i=$((i+1))
+	done
+	kill -9 $pid
+	wait $pid 2> /dev/null
+	exec 3>&-
+	rm -f "$input"
+	cp "$file" "$input"
+
+	printf '%s\n' "NDC_CHECKPOINT_INTERVAL=1024 ${debug_cmd}\"$bin\" -b 512 -f -k \"$dump.ck\" -K -d \"$dump\" -t $type \"$input\""
+	[ -e "$dump.ck" ] && NDC_CHECKPOINT_INTERVAL=1024 $debug_cmd "$bin" \
+		-b 512 -f -k "$dump.ck" -K -d "$dump" -t "$type" "$input"
+	result=$?
+
+	# the header names the input
+	sed -i "1s|$input|$file|" "$dump"
+	[ $result -eq 0 ] && diff -q "$dump" "$binary" > /dev/null \
+		&& [ ! -e "$dump.ck" ]
+	result=$?
+	rm -f "$input"
+	check_result $result
+}
+
+checksum () {
+	current_test_name="checksum"
+
+	before_test
+
+	sum=$(sha256sum "$file" | cut -d' ' -f1)
+
+	# checksum is printed next to the last offset
+	default_dump_cmd -c sha256
+	ndc_sum=$(tail -n1 "$dump" | sed 's/^sha256=//')
+
+	prepare_dump_for_reverse_operation
+	sed -i '$d' "$dump"
+
+	# reverse mode prints the checksum of the reconstructed bytes to stderr
+	rev_sum=$(default_reverse_cmd -c sha256 2>&1 >/dev/null \
+		| sed 's/.*sha256=//')
+
+	if [ "$sum" != "$ndc_sum" ] || [ "$sum" != "$rev_sum" ]; then
+		print_red "$file: test $current_test_name failed; sha256 should "\
+			"be $sum, but was $ndc_sum (dump) and $rev_sum (reverse)."
+		success=false
+	else
+		print_green "$file: test $current_test_name passed."
+	fi
+}
+
 check_format_ascii () {
 	current_test_name="check_format_ascii"
 
@@ -157,19 +353,93 @@ check_offset_value () {
 	# get file size from ndc (last offset)
 	ndc_size=$(tail -n1 "$dump" | cut -d' ' -f1 | sed 's/^0*//')
 
-	if [ "$size" != "$ndc_size" ]; then
+	# with "-o", the offsets have no leading zeros
+	printf '%s\n' "${debug_cmd}\"$bin\" -f -o -t $type \"$file\" | tail -n1"
+	short_size=$($debug_cmd "$bin" -f -o -t "$type" "$file" | tail -n1 \
+		| cut -d' ' -f1)
+
+	# the input ends within masked lines (dump() used to wait forever)
+	printf '%s\n' "head -c 64 /dev/zero | ${debug_cmd}\"$bin\" -t $type | tail -n1"
+	masked_size=$(head -c 64 /dev/zero \
+		| timeout 10 $debug_cmd "$bin" -t "$type" | tail -n1 \
+		| cut -d' ' -f1 | sed 's/^0*//')
+
+	if [ "$size" != "$ndc_size" ] || [ "$size" != "$short_size" ]; then
 		print_red "$file: test $current_test_name failed; size should "\
-			"be $size, but was $ndc_size."
+			"be $size, but was $ndc_size ($short_size with \"-o\")."
+		success=false
+	elif [ "$masked_size" != 40 ]; then
+		print_red "$file: test $current_test_name failed; size of 64 "\
+			"zero bytes should be 40, but was $masked_size."
 		success=false
 	else
 		print_green "$file: test $current_test_name passed."
 	fi
 }
 
+cache () {
+	current_test_name="cache"
+
+	before_test
+
+	# the second run has to take every block from the cache
+	rm -rf "$dump.cache"
+	printf '%s\n' "${debug_cmd}\"$bin\" -a -t $type \"$file\" > \"$binary\""
+	$debug_cmd "$bin" -a -t "$type" "$file" > "$binary"
+	printf '%s\n' "${debug_cmd}\"$bin\" -a -t $type -C \"$dump.cache\" \"$file\" > \"$dump\""
+	$debug_cmd "$bin" -a -t "$type" -C "$dump.cache" "$file" > "$dump"
+	entries=$(find "$dump.cache" -type f | wc -l)
+	diff -q "$dump" "$binary" > /dev/null
+	first=$?
+	$debug_cmd "$bin" -a -t "$type" -C "$dump.cache" "$file" > "$dump"
+
+	[ "$first" -eq 0 ] && diff -q "$dump" "$binary" > /dev/null \
+		&& [ "$(find "$dump.cache" -type f | wc -l)" -eq "$entries" ]
+	check_result $?
+	rm -rf "$dump.cache"
+}
+
+compress () {
+	current_test_name="compress"
+
+	before_test
+
+	# gzip-compressed input and compressed output
+	printf '%s\n' "${debug_cmd}\"$bin\" -a -t $type < \"$file\" > \"$binary\""
+	$debug_cmd "$bin" -a -t "$type" < "$file" > "$binary"
+	printf '%s\n' "gzip -c \"$file\" | ${debug_cmd}\"$bin\" -a -t $type > \"$dump\""
+	gzip -c "$file" | $debug_cmd "$bin" -a -t "$type" > "$dump"
+	diff -q "$dump" "$binary" > /dev/null
+	first=$?
+	printf '%s\n' "${debug_cmd}\"$bin\" -a -t $type -z 1 < \"$file\" | gunzip > \"$dump\""
+	$debug_cmd "$bin" -a -t "$type" -z 1 < "$file" | gunzip > "$dump"
+
+	[ "$first" -eq 0 ] && diff -q "$dump" "$binary" > /dev/null
+	check_result $?
+}
+
 default () {
+	analysis
+	arena
+	cache
+	checkpoint
+	checksum
 	check_format_ascii
 	check_offset_value
+	compress
+	dictionary
+	foreign
+	index
+	memory
+	multi
+	parallel
+	patch
+	plain
+	profile
+	progress
 	reverse
+	sample
+	server
 	skip_limit
 	width
 }
@@ -184,6 +454,288 @@ default_reverse_cmd () {
 	$debug_cmd "$bin" -d "$binary" -t "$type" -r "$@" "$dump"
 }
 
+dictionary () {
+	current_test_name="dictionary"
+
+	before_test
+
+	size=$(shuf -n1 -i 1-65536)
+	default_dump_cmd -m "$size"
+
+	prepare_dump_for_reverse_operation
+
+	default_reverse_cmd -m "$size"
+
+	check_diff
+
+	# with "-l", the short last line must not become a back-reference
+	before_test
+	pattern="$binary.pattern"
+	for i in 1 2 3 4; do
+		head -c 16 "$file"
+	done > "$pattern"
+	printf '%s\n' "${debug_cmd}\"$bin\" -n -f -w 16 -m 4096 -l 40 -d \"$dump\" -t $type \"$pattern\""
+	$debug_cmd "$bin" -n -f -w 16 -m 4096 -l 40 -d "$dump" -t "$type" \
+		"$pattern"
+	prepare_dump_for_reverse_operation
+	default_reverse_cmd -m 4096
+
+	head -c 40 "$pattern" | cmp -s - "$binary"
+	result=$?
+	rm -f "$pattern"
+	check_result $result
+}
+
+foreign () {
+	current_test_name="foreign"
+
+	# the layouts of other tools are recognised for hexadecimal only
+	[ "$type" = x ] || return 0
+
+	before_test
+
+	# od is always there, xxd only with vim
+	printf '%s\n' "od -tx1 \"$file\" | ${debug_cmd}\"$bin\" -t x -r > \"$binary\""
+	od -tx1 "$file" | $debug_cmd "$bin" -t x -r > "$binary"
+	diff -q "$file" "$binary" > /dev/null
+	result=$?
+	if [ "$result" -eq 0 ] && type xxd > /dev/null 2>&1; then
+		xxd -a "$file" > "$dump"
+		printf '%s\n' "${debug_cmd}\"$bin\" -t x -r \"$dump\" > \"$binary\""
+		$debug_cmd "$bin" -t x -r "$dump" > "$binary"
+		diff -q "$file" "$binary" > /dev/null
+		result=$?
+	fi
+	# first lines longer than the prefix looked at (4096 characters), from
+	# a pipe, so that the prefix cannot be read again
+	if [ "$result" -eq 0 ]; then
+		printf '%s\n' "od -tx1 -v -w2048 \"$file\" | ${debug_cmd}\"$bin\" -t x -r > \"$binary\""
+		od -tx1 -v -w2048 "$file" | $debug_cmd "$bin" -t x -r > "$binary"
+		diff -q "$file" "$binary" > /dev/null
+		result=$?
+	fi
+
+	check_result $result
+}
+
+index () {
+	current_test_name="index"
+
+	before_test
+
+	size=$(stat -Lc '%s' "$file")
+	skip=$(shuf -n1 -i 0-"$size")
+	stride=$(shuf -n1 -i 1-65536)
+	default_dump_cmd -I "$dump.idx" -i "$stride"
+
+	prepare_dump_for_reverse_operation
+
+	default_reverse_cmd -I "$dump.idx" -s "$skip"
+
+	tail -c +$((skip+1)) "$file" | diff -q - "$binary" > /dev/null
+	check_result $?
+	rm -f "$dump.idx"
+}
+
+memory () {
+	current_test_name="memory"
+
+	before_test
+
+	# the first mapping of a process (does not depend on "$file")
+	sleep 10 &
+	pid=$!
+	# not the mappings of the shell before the exec
+	until [ "$(cat "/proc/$pid/comm")" = sleep ]; do :; done
+	range=$(head -n1 "/proc/$pid/maps" | cut -d' ' -f1)
+	start=$(printf '%d' "0x${range%-*}")
+	end=$(printf '%d' "0x${range#*-}")
+	dd if="/proc/$pid/mem" of="$binary" bs=4096 iflag=skip_bytes,count_bytes \
+		skip="$start" count=$((end-start)) 2> /dev/null
+
+	printf '%s\n' "${debug_cmd}\"$bin\" -f -M $pid:$range -t $type -d \"$dump\""
+	$debug_cmd "$bin" -f -M "$pid:$range" -t "$type" -d "$dump"
+	# write errors have to be reported by the exit status
+	printf '%s\n' "${debug_cmd}\"$bin\" -f -M $pid:$range -t $type -d /dev/full"
+	$debug_cmd "$bin" -f -M "$pid:$range" -t "$type" -d /dev/full 2> /dev/null
+	full=$?
+	kill "$pid"
+
+	# the offsets have to be the addresses
+	first=$(sed -n '2s/ .*//p' "$dump")
+	last=$(tail -n1 "$dump" | cut -d' ' -f1)
+	prepare_dump_for_reverse_operation
+	sed -i -e '$d' -e 's/^[0-9A-F]*  //' "$dump"
+	printf '%s\n' "${debug_cmd}\"$bin\" -t $type -r \"$dump\" > \"$dump.bin\""
+	$debug_cmd "$bin" -t "$type" -r "$dump" > "$dump.bin"
+
+	[ "$((0x$first))" -eq "$start" ] && [ "$((0x$last))" -eq "$end" ] \
+		&& diff -q "$dump.bin" "$binary" > /dev/null && [ "$full" -ne 0 ]
+	check_result $?
+	rm -f "$dump.bin"
+}
+
+multi () {
+	current_test_name="multi"
+
+	before_test
+
+	# decimal in the same pass, written to "$binary"
+	rm -f "$binary"
+	default_dump_cmd -a -T "d:$binary"
+	printf '%s\n' "${debug_cmd}\"$bin\" -a -n -f -t d \"$file\" > \"$dump\""
+	$debug_cmd "$bin" -a -n -f -t d "$file" > "$dump"
+
+	diff -q "$dump" "$binary" > /dev/null
+	check_result $?
+}
+
+parallel () {
+	current_test_name="parallel"
+
+	before_test
+
+	# the serial dump goes to "$binary" for comparison
+	width=$(shuf -n1 -i 1-256)
+	printf '%s\n' "${debug_cmd}\"$bin\" -a -f -w $width -d \"$binary\" -t $type \"$file\""
+	$debug_cmd "$bin" -a -f -w "$width" -d "$binary" -t "$type" "$file"
+	printf '%s\n' "${debug_cmd}\"$bin\" -j 4 -b 4096 -a -f -w $width -d \"$dump\" -t $type \"$file\""
+	$debug_cmd "$bin" -j 4 -b 4096 -a -f -w "$width" -d "$dump" -t "$type" "$file"
+
+	diff -q "$dump" "$binary" > /dev/null
+	check_result $?
+
+	# decoded in parallel chunks, whose seams must not split numbers
+	before_test
+	default_dump_cmd -w "$width"
+	prepare_dump_for_reverse_operation
+	default_reverse_cmd -j 4
+	check_diff
+}
+
+patch () {
+	current_test_name="patch"
+
+	before_test
+
+	# with offsets and the ASCII column, which has to be ignored
+	printf '%s\n' "${debug_cmd}\"$bin\" -a -f -d \"$dump\" -t $type \"$file\""
+	$debug_cmd "$bin" -a -f -d "$dump" -t "$type" "$file"
+
+	# every byte of the file of zeros has to be patched
+	head -c "$(stat -Lc '%s' "$file")" /dev/zero > "$binary"
+	printf '%s\n' "${debug_cmd}\"$bin\" -P \"$binary\" -t $type \"$dump\""
+	$debug_cmd "$bin" -P "$binary" -t "$type" "$dump"
+
+	check_diff
+
+	# back-references of "-m" are skipped: patching a copy of the input
+	# with its own dump must succeed and change nothing
+	before_test
+	{ head -c 4096 "$file"; head -c 4096 "$file"; } > "$binary"
+	cp "$binary" "$dump.orig"
+	printf '%s\n' "${debug_cmd}\"$bin\" -f -m 8192 -d \"$dump\" -t $type \"$binary\""
+	$debug_cmd "$bin" -f -m 8192 -d "$dump" -t "$type" "$binary"
+	printf '%s\n' "${debug_cmd}\"$bin\" -P \"$binary\" -t $type \"$dump\""
+	$debug_cmd "$bin" -P "$binary" -t "$type" "$dump" \
+		&& grep -q '@' "$dump" && cmp -s "$binary" "$dump.orig"
+	result=$?
+	rm -f "$dump.orig"
+	check_result $result
+}
+
+plain () {
+	current_test_name="plain"
+
+	before_test
+
+	# dump binary as plain stream with a random wrap column (0 = no wrap)
+	wrap=$(shuf -n1 -i 0-1024)
+	printf '%s\n' "${debug_cmd}\"$bin\" -p -w $wrap -d \"$dump\" -t $type \"$file\""
+	$debug_cmd "$bin" -p -w "$wrap" -d "$dump" -t "$type" "$file"
+
+	# strict reverse operation
+	default_reverse_cmd -p
+
+	check_diff
+}
+
+profile () {
+	current_test_name="profile"
+
+	before_test
+
+	# a hand-written profile (cf. "-A") with the table kernels, an odd
+	# bufsize and 4 threads, so that the dump and the reverse operation run
+	# in parallel
+	profile="$binary.profile"
+	printf 'ndc profile 1\nkernel plain-hex table\nkernel crc32c table\n' \
+		> "$profile"
+	printf 'bufsize file %s 4099\njobs 4\n' "$type" >> "$profile"
+
+	# the table kernels give the same plain dump and checksum as the SIMD ones
+	printf '%s\n' "${debug_cmd}\"$bin\" -p -c crc32c -t $type \"$file\""
+	for kernels in simd table; do
+		[ $kernels = simd ] && with= || with="$profile"
+		NDC_PROFILE="$with" $debug_cmd "$bin" -p -c crc32c -t "$type" \
+			"$file" > "$binary.$kernels" 2> "$binary.$kernels.crc"
+	done
+	cmp -s "$binary.simd" "$binary.table" \
+		&& cmp -s "$binary.simd.crc" "$binary.table.crc"
+	check_result $?
+	rm -f "$binary.simd" "$binary.simd.crc" "$binary.table" \
+		"$binary.table.crc"
+
+	NDC_PROFILE="$profile"
+	export NDC_PROFILE
+
+	default_dump_cmd
+	prepare_dump_for_reverse_operation
+	default_reverse_cmd
+
+	unset NDC_PROFILE
+	rm -f "$profile"
+	check_diff
+}
+
+progress () {
+	current_test_name="progress"
+
+	before_test
+
+	# "-g" reports the end of every file
+	size=$(wc -c < "$file")
+	printf '%s\n' "${debug_cmd}\"$bin\" -f -g 60 -t $type -d \"$dump\" \"$file\" 2> \"$binary\""
+	$debug_cmd "$bin" -f -g 60 -t "$type" -d "$dump" "$file" 2> "$binary"
+
+	grep -q ": $size bytes (100.0%)" "$binary"
+	check_result $?
+
+	# the other modes report, too ("-j" after every completed chunk)
+	for opts in "-p" "-e 4096" "-C $dump.cache" "-T $type:$dump.multi" \
+			"-j 4"; do
+		printf '%s\n' "${debug_cmd}\"$bin\" $opts -f -g 60 -t $type -d \"$dump\" \"$file\" 2> \"$binary\""
+		$debug_cmd "$bin" $opts -f -g 60 -t "$type" -d "$dump" "$file" \
+			2> "$binary"
+		grep -q ": $size bytes (100.0%)" "$binary"
+		check_result $?
+	done
+	rm -rf "$dump.cache" "$dump.multi"
+
+	# in reverse mode, the bytes of the input (the dump)
+	for opts in "" "-j 4" "-p"; do
+		printf '' > "$dump"
+		"$bin" ${opts#-j 4} -n -f -t "$type" -d "$dump" "$file"
+		[ "$opts" != "-p" ] && prepare_dump_for_reverse_operation
+		size=$(wc -c < "$dump")
+		printf '%s\n' "${debug_cmd}\"$bin\" -r $opts -g 60 -t $type -d /dev/null \"$dump\" 2> \"$binary\""
+		$debug_cmd "$bin" -r $opts -g 60 -t "$type" -d /dev/null "$dump" \
+			2> "$binary"
+		grep -q ": $size bytes (100.0%)" "$binary"
+		check_result $?
+	done
+}
+
 reverse () {
 	current_test_name="reverse"
 
@@ -228,6 +780,88 @@ skip_limit_intern () {
 	check_diff
 }
 
+sample () {
+	current_test_name="sample"
+
+	before_test
+
+	# complete dump for comparison
+	printf '%s\n' "${debug_cmd}\"$bin\" -a -f -d \"$binary\" -t $type \"$file\""
+	$debug_cmd "$bin" -a -f -d "$binary" -t "$type" "$file"
+
+	count=$(shuf -n1 -i 1-64)
+	seed=$(shuf -n1 -i 0-65535)
+	printf '%s\n' "${debug_cmd}\"$bin\" -a -S random:$count:$seed -d \"$dump\" -t $type \"$file\""
+	$debug_cmd "$bin" -a -S "random:$count:$seed" -d "$dump" -t "$type" "$file"
+
+	# every line but the separators has to be part of the complete dump
+	lines=$(grep -vx -- '--' "$dump" | grep -cvxFf "$binary")
+	[ "$lines" -eq 0 ]
+	check_result $?
+
+	# more probes than lines (here: the maximum) select every line
+	before_test
+	$debug_cmd "$bin" -a -f -d "$binary" -t "$type" "$file"
+	printf '%s\n' "${debug_cmd}\"$bin\" -a -S probe:18446744073709551615 -d \"$dump\" -t $type \"$file\""
+	$debug_cmd "$bin" -a -S probe:18446744073709551615 -d "$dump" \
+		-t "$type" "$file"
+	diff -q "$dump" "$binary" > /dev/null
+	check_result $?
+}
+
+server () {
+	current_test_name="server"
+
+	before_test
+
+	socket="$dump.sock"
+	"$bin" -U "$socket" -j 2 &
+	server_pid=$!
+	while [ ! -S "$socket" ]; do sleep 0.1; done
+
+	# only the user of the server may connect
+	mode=$(stat -c '%a' "$socket")
+	if [ "$mode" != 600 ]; then
+		print_red "$file: test $current_test_name failed; socket has "\
+			"mode $mode, not 600."
+		success=false
+	fi
+
+	# the file is read by the server, the dump from stdin of the client
+	default_dump_cmd -u "$socket"
+	prepare_dump_for_reverse_operation
+	printf '%s\n' "${debug_cmd}\"$bin\" -u \"$socket\" -t $type -r < \"$dump\" > \"$binary\""
+	$debug_cmd "$bin" -u "$socket" -t "$type" -r < "$dump" > "$binary"
+
+	# a client cannot start the benchmarks of "-A" in a worker
+	if "$bin" -u "$socket" -A > /dev/null 2>&1; then
+		print_red "$file: test $current_test_name failed; the server "\
+			"accepted \"-A\"."
+		success=false
+	fi
+
+	kill "$server_pid"
+	wait "$server_pid" 2> /dev/null
+	rm -f "$socket"
+
+	check_diff
+
+	# one worker writes to pipes the ring of "-p" was not sized for
+	"$bin" -U "$socket" -j 1 &
+	server_pid=$!
+	while [ ! -S "$socket" ]; do sleep 0.1; done
+	for opts in "-t $type" "-t b -w 1"; do
+		printf '%s\n' "${debug_cmd}\"$bin\" -u \"$socket\" -p $opts \"$file\" | cat > \"$dump\""
+		$debug_cmd "$bin" -u "$socket" -p $opts "$file" | cat > "$dump"
+		"$bin" -p $opts "$file" > "$binary"
+		diff -q "$dump" "$binary" > /dev/null
+		check_result $?
+	done
+	kill "$server_pid"
+	wait "$server_pid" 2> /dev/null
+	rm -f "$socket"
+}
+
 skip_limit () {
 	current_test_name="skip_limit"
 
@@ -340,14 +974,50 @@ done
 
 test_option="$1"
 case "$test_option" in
+	"analysis")
+		test_cmd () { analysis; };;
+	"arena")
+		test_cmd () { arena; };;
+	"cache")
+		test_cmd () { cache; };;
+	"checkpoint")
+		test_cmd () { checkpoint; };;
+	"checksum")
+		test_cmd () { checksum; };;
 	"check_format_ascii")
 		test_cmd () { check_format_ascii; };;
 	"check_offset_value")
 		test_cmd () { check_offset_value; };;
+	"compress")
+		test_cmd () { compress; };;
 	"default")
 		test_cmd () { default; };;
+	"dictionary")
+		test_cmd () { dictionary; };;
+	"foreign")
+		test_cmd () { foreign; };;
+	"index")
+		test_cmd () { index; };;
+	"memory")
+		test_cmd () { memory; };;
+	"multi")
+		test_cmd () { multi; };;
+	"parallel")
+		test_cmd () { parallel; };;
+	"patch")
+		test_cmd () { patch; };;
+	"plain")
+		test_cmd () { plain; };;
+	"profile")
+		test_cmd () { profile; };;
+	"progress")
+		test_cmd () { progress; };;
 	"reverse")
 		test_cmd () { reverse; };;
+	"sample")
+		test_cmd () { sample; };;
+	"server")
+		test_cmd () { server; };;
 	"skip_limit")
 		test_cmd () { skip_limit; };;
 	"width")
@@ -0,0 +1,467 @@
+/*
+ * ndc - numeric dump and conversion
+ * Copyright (C) 2019-2020 Robert Imschweiler
+ * 
+ * This file is part of ndc.
+ * 
+ * ndc is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * ndc is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Autotuning (option "-A"): short benchmarks of this host find the faster
+ * variant of every kernel with one (cf. enum Kernel) - the portable lookup
+ * table or SIMD instructions, if the CPU has them -, the fastest bufsize
+ * ("-b") for every type and kind of input - regular files (and devices) or
+ * pipes - and the fastest number of threads ("-j"). They are stored in the
+ * profile of the host, which later runs read at startup: tune_simd() selects
+ * the kernels, without "-b", io_bufsize() takes the bufsize of the profile,
+ * without "-j", the parallel dump and reverse mode take its number of threads
+ * (not the server and "-T", cf. params.parallel_jobs).
+ *
+ * The profile is $NDC_PROFILE (none if empty) or
+ * ${XDG_CACHE_HOME:-$HOME/.cache}/ndc/profile-HOSTNAME, a text file:
+ *   ndc profile 1
+ *   kernel NAME VARIANT        (NAME: plain-hex or crc32c, VARIANT: table or
+ *                               simd)
+ *   bufsize KIND TYPE SIZE     (KIND: file or pipe, TYPE as for "-t")
+ *   jobs N
+ * Without a profile, every kernel uses SIMD instructions if the CPU has them.
+ *
+ * The benchmarks dump SAMPLE_SIZE pseudo-random bytes from a temporary file
+ * (or through a FIFO fed by a child process) to /dev/null - in plain mode for
+ * the plain-hex kernel, the crc32c kernel checksums them in-process -, the
+ * threads are measured by the parallel reverse mode, which scales like the
+ * parallel dump, but does not need an output file.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "checksum.h"
+#include "libgetopt_portable/libgetopt_portable.h"
+#include "repository.h"
+#include "repository_definition.h"
+#include "tune.h"
+#include "util.h"
+/* last */
+#include "ndc.h"
+
+
+/* first line of a profile */
+#define MAGIC        "ndc profile 1\n"
+/* bytes dumped by every benchmark */
+#define SAMPLE_SIZE  (4 << 20)
+/* every benchmark is run this often, the fastest run counts */
+#define REPEAT       2
+/* smallest and biggest bufsize tried (every fourth power of two between) */
+#define BUFSIZE_MIN  (4 << 10)
+#define BUFSIZE_MAX  (4 << 20)
+
+
+/* variants of a kernel in the profile */
+enum Variant {
+	VARIANT_AUTO,  /* SIMD if the CPU has it */
+	VARIANT_TABLE,
+	VARIANT_SIMD,
+};
+
+
+static double  bench(const char *path, const unsigned char *sample,
+		bool pipe);
+static double  bench_crc32c(const unsigned char *sample);
+static void    load(void);
+static bool    profile_path(char *out, size_t size, bool create);
+
+
+/* private variables */
+/*
+ * loaded    whether the profile has been read
+ * kernel    variant of every kernel, cf. enum Variant
+ * bufsize   bufsize of every kind of input (file, pipe) and type, 0 = auto
+ * jobs      number of threads, 0 = default
+ */
+static struct {
+	bool loaded;
+	enum Variant kernel[KERNEL_COUNT];
+	size_t bufsize[2][TYPE_COUNT];
+	unsigned jobs;
+} profile;
+
+static const char *const kernel_name[KERNEL_COUNT] = {
+	[KERNEL_PLAIN_HEX] = "plain-hex",
+	[KERNEL_CRC32C] = "crc32c",
+};
+static const char *const variant_name[] = {
+	[VARIANT_AUTO] = "auto",
+	[VARIANT_TABLE] = "table",
+	[VARIANT_SIMD] = "simd",
+};
+
+
+/*
+ * Run ndc with the current "params" and "type" on the file "path" - or, with
+ * "pipe", on the FIFO "path" fed with "sample" by a child process.
+ *
+ * return seconds of the fastest run.
+ */
+double
+bench(const char *path, const unsigned char *sample, bool pipe)
+{
+	char *argv[] = { (char *)path, NULL };
+	double best = 0, t;
+	unsigned r;
+	size_t n;
+	ssize_t w;
+	pid_t pid = 0;
+	int fd;
+
+	for (r = 0; r < REPEAT; r++) {
+		if (pipe && !(pid = fork())) {
+			if ((fd = open(path, O_WRONLY)) < 0)
+				_exit(EXIT_FAILURE);
+			for (n = 0; n < SAMPLE_SIZE; n += w) {
+				if ((w = write(fd, sample+n, SAMPLE_SIZE-n)) < 0)
+					_exit(EXIT_FAILURE);
+			}
+			_exit(EXIT_SUCCESS);
+		} else if (pid < 0) {
+			die("fork: %s", strerror(errno));
+		}
+
+		t = seconds();
+		opt_ind = 0;
+		run(1, argv);
+		t = seconds()-t;
+		if (!r || t < best)
+			best = t;
+
+		if (pipe)
+			waitpid(pid, NULL, 0);
+	}
+
+	return best;
+}
+
+/*
+ * Checksum "sample" with CRC32C, using the kernel checksum_init() selects.
+ *
+ * return seconds of the fastest run.
+ */
+double
+bench_crc32c(const unsigned char *sample)
+{
+	double best = 0, t;
+	unsigned r;
+
+	for (r = 0; r < REPEAT; r++) {
+		checksum_init(CHECKSUM_CRC32C);
+		t = seconds();
+		checksum_update(sample, SAMPLE_SIZE);
+		t = seconds()-t;
+		if (!r || t < best)
+			best = t;
+	}
+
+	return best;
+}
+
+/* Read the profile once; a missing or invalid one is ignored. */
+void
+load(void)
+{
+	char path[4096], line[256], kind[16], format[8];
+	size_t size;
+	unsigned i, j, jobs;
+	FILE *f;
+
+	if (profile.loaded)
+		return;
+	profile.loaded = true;
+
+	if (!profile_path(path, sizeof(path), false)
+			|| !(f = fopen(path, "r")))
+		return;
+	if (!fgets(line, sizeof(line), f) || strcmp(line, MAGIC)) {
+		fclose(f);
+		return;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "kernel %15s %7s", kind, format) == 2) {
+			for (i = 0; i < KERNEL_COUNT; i++) {
+				for (j = VARIANT_TABLE; j <= VARIANT_SIMD; j++) {
+					if (!strcmp(kind, kernel_name[i])
+							&& !strcmp(format, variant_name[j]))
+						profile.kernel[i] = j;
+				}
+			}
+		} else if (sscanf(line, "bufsize %7s %7s %zu", kind, format, &size)
+				== 3) {
+			for (i = 0; i < TYPE_COUNT; i++) {
+				if (!strcmp(format, repo[i].format))
+					profile.bufsize[!strcmp(kind, "pipe")][i] = size;
+			}
+		} else if (sscanf(line, "jobs %u", &jobs) == 1) {
+			profile.jobs = jobs;
+		}
+	}
+	fclose(f);
+}
+
+/*
+ * Path of the profile of this host to "out" (cf. above); "create" its
+ * directory.
+ *
+ * return false if there is none.
+ */
+bool
+profile_path(char *out, size_t size, bool create)
+{
+	const char *env, *sub = "";
+	char host[256] = "";
+	size_t n;
+
+	if ((env = getenv("NDC_PROFILE"))) {
+		snprintf(out, size, "%s", env);
+		return *env;
+	}
+	if (!(env = getenv("XDG_CACHE_HOME")) || !*env) {
+		if (!(env = getenv("HOME")) || !*env)
+			return false;
+		sub = "/.cache";
+	}
+	gethostname(host, sizeof(host)-1);
+
+	n = snprintf(out, size, "%s%s", env, sub);
+	if (create && mkdir(out, 0777) && errno != EEXIST)
+		return false;
+	n += snprintf(out+n, size > n ? size-n : 0, "/ndc");
+	if (create && mkdir(out, 0777) && errno != EEXIST)
+		return false;
+	snprintf(out+n, size > n ? size-n : 0, "/profile-%s", host);
+
+	return true;
+}
+
+/*
+ * Bufsize of the profile for the current type and a pipe ("pipe") or a
+ * regular file or device.
+ *
+ * return 0 if there is none.
+ */
+size_t
+tune_bufsize(bool pipe)
+{
+	load();
+
+	return profile.bufsize[pipe][type.type == NONE ? HEX_UC : type.type];
+}
+
+/*
+ * Run the benchmarks, print their results and write the profile.
+ */
+void
+tune_calibrate(void)
+{
+	const Params base = params;
+	const Repository base_type = type;
+	char dir[] = "/tmp/ndc-tune.XXXXXX", data[64], fifo[64], text[64];
+	char path[4096], tmp[4096+32];
+	unsigned char *sample;
+	uint64_t x = 0x9e3779b97f4a7c15;
+	size_t i, size, best_size[2][TYPE_COUNT];
+	enum Variant v, best_variant[KERNEL_COUNT];
+	unsigned k, t, pipe, jobs, cpus, best_jobs = 1;
+	double s, best;
+	FILE *f;
+	long n;
+
+	if (!mkdtemp(dir))
+		die("mkdtemp: %s", strerror(errno));
+	snprintf(data, sizeof(data), "%s/data", dir);
+	snprintf(fifo, sizeof(fifo), "%s/fifo", dir);
+	snprintf(text, sizeof(text), "%s/text", dir);
+
+	/* xorshift64: incompressible, no identical lines */
+	sample = _malloc(SAMPLE_SIZE);
+	for (i = 0; i < SAMPLE_SIZE; i++) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		sample[i] = x >> 56;
+	}
+	if (!(f = fopen(data, "wb"))
+			|| fwrite(sample, 1, SAMPLE_SIZE, f) != SAMPLE_SIZE
+			|| fclose(f) || mkfifo(fifo, 0600))
+		die("Failed to create the files in \"%s\".", dir);
+	/* input of the parallel reverse mode, like "-n -t X" would dump it */
+	if (!(f = fopen(text, "w")))
+		die("Failed to create \"%s\": %s", text, strerror(errno));
+	for (i = 0; i < SAMPLE_SIZE; i++)
+		fprintf(f, "%02X%c", sample[i], i % 16 == 15 ? '\n' : ' ');
+	if (fclose(f))
+		die("Failed to write \"%s\".", text);
+
+	/* independent of the current profile, the best kernels apply below */
+	memset(&profile, 0, sizeof(profile));
+	profile.loaded = true;
+
+	for (k = 0; k < KERNEL_COUNT; k++) {
+		best = 0;
+		best_variant[k] = VARIANT_TABLE;
+		for (v = VARIANT_TABLE; v <= VARIANT_SIMD; v++) {
+			profile.kernel[k] = v;
+			if (v == VARIANT_SIMD && !tune_simd(k))
+				break; /* not supported by this CPU (or build) */
+			if (k == KERNEL_CRC32C) {
+				s = bench_crc32c(sample);
+			} else {
+				params = base;
+				params.plain = true;
+				params.width = 0;
+				params.outfile = "/dev/null";
+				type = repo[HEX_UC];
+				s = bench(data, sample, false);
+			}
+			if (!best || s < best) {
+				best = s;
+				best_variant[k] = v;
+			}
+		}
+		profile.kernel[k] = best_variant[k];
+		printf("kernel %s: %s (%.1f MB/s)\n", kernel_name[k],
+				variant_name[best_variant[k]], SAMPLE_SIZE/best/1e6);
+	}
+
+	for (pipe = 0; pipe < 2; pipe++) {
+		for (t = 0; t < TYPE_COUNT; t++) {
+			best = 0;
+			for (size = BUFSIZE_MIN; size <= BUFSIZE_MAX; size *= 4) {
+				params = base;
+				params.bufsize = size;
+				params.outfile = "/dev/null";
+				type = repo[t];
+				s = bench(pipe ? fifo : data, sample, pipe);
+				if (!best || s < best) {
+					best = s;
+					best_size[pipe][t] = size;
+				}
+			}
+			printf("bufsize %s %s: %zu (%.1f MB/s)\n",
+					pipe ? "pipe" : "file", repo[t].format,
+					best_size[pipe][t], SAMPLE_SIZE/best/1e6);
+		}
+	}
+
+	cpus = (n = sysconf(_SC_NPROCESSORS_ONLN)) > 0 ? n : 1;
+	best = 0;
+	for (jobs = 1; jobs <= cpus; jobs = jobs*2 > cpus && jobs < cpus ?
+			cpus : jobs*2) {
+		params = base;
+		params.parallel_jobs = jobs;
+		params.reverse = true;
+		params.outfile = "/dev/null";
+		type = repo[HEX_UC];
+		s = bench(text, sample, false);
+		if (!best || s < best) {
+			best = s;
+			best_jobs = jobs;
+		}
+	}
+	printf("jobs: %u (%.1f MB/s)\n", best_jobs, SAMPLE_SIZE/best/1e6);
+
+	params = base;
+	type = base_type;
+	unlink(data);
+	unlink(fifo);
+	unlink(text);
+	rmdir(dir);
+	memset(sample, 0, SAMPLE_SIZE);
+	free(sample);
+
+	/* written atomically, like the entries of cache.c */
+	if (!profile_path(path, sizeof(path), true))
+		die("No profile: NDC_PROFILE is empty or HOME is not set.");
+	snprintf(tmp, sizeof(tmp), "%s.%ld", path, (long)getpid());
+	if (!(f = fopen(tmp, "w")))
+		die("Failed to create \"%s\": %s", tmp, strerror(errno));
+	fputs(MAGIC, f);
+	for (k = 0; k < KERNEL_COUNT; k++)
+		fprintf(f, "kernel %s %s\n", kernel_name[k],
+				variant_name[best_variant[k]]);
+	for (pipe = 0; pipe < 2; pipe++) {
+		for (t = 0; t < TYPE_COUNT; t++)
+			fprintf(f, "bufsize %s %s %zu\n", pipe ? "pipe" : "file",
+					repo[t].format, best_size[pipe][t]);
+	}
+	fprintf(f, "jobs %u\n", best_jobs);
+	if (fclose(f) || rename(tmp, path)) {
+		unlink(tmp);
+		die("Failed to write \"%s\": %s", path, strerror(errno));
+	}
+	printf("profile: %s\n", path);
+
+	/* the new profile applies to this process, too */
+	profile.loaded = false;
+}
+
+/*
+ * Number of threads of the profile.
+ *
+ * return 0 if there is none.
+ */
+unsigned
+tune_jobs(void)
+{
+	load();
+
+	return profile.jobs;
+}
+
+/*
+ * Whether to use the SIMD variant of "kernel": if the CPU has the instructions
+ * (and this build is for x86) and the profile does not prefer the table.
+ */
+bool
+tune_simd(enum Kernel kernel)
+{
+	bool cpu = false;
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	switch (kernel) {
+	case KERNEL_PLAIN_HEX:
+		cpu = __builtin_cpu_supports("ssse3");
+		break;
+	case KERNEL_CRC32C:
+		cpu = CHAR_BIT == 8 && __builtin_cpu_supports("sse4.2");
+		break;
+	default:
+		break;
+	}
+#endif
+	load();
+
+	return cpu && profile.kernel[kernel] != VARIANT_TABLE;
+}
@@ -18,6 +18,8 @@
  * along with ndc.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <errno.h>
 #include <inttypes.h>
 #include <stdarg.h>
@@ -25,6 +27,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "util.h"
 
@@ -96,3 +99,13 @@ is_power_of_two(uint_fast64_t n)
 	return n && !(n & (n-1));
 }
 
+/* monotonic time in seconds */
+double
+seconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
@@ -22,11 +22,12 @@
 #define UITL_H
 
 
-void  *_calloc(size_t n, size_t s);
-void  *_malloc(size_t n);
-void  die(const char *format, ...);
-void  err(const char *format, ...);
-bool  is_power_of_two(uint_fast64_t n);
+void    *_calloc(size_t n, size_t s);
+void    *_malloc(size_t n);
+void     die(const char *format, ...);
+void     err(const char *format, ...);
+bool     is_power_of_two(uint_fast64_t n);
+double   seconds(void);
 
 
 #endif /* UITL_H */